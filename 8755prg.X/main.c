@@ -31,14 +31,38 @@
 #define DEV_8748 6
 #define DEV_8749 7
 
+// Names of the devices, by type, see do_iden()
+static const char* const dev_names[] = {
+    "2716", "2732", "2532", "2708", "T2716", "8755", "8748", "8749"
+};
+#define NDEVS ((int8_t) (sizeof(dev_names)/sizeof(dev_names[0])))
+
+// The 2708 and TMS2716 are programmed in passes over the whole device,
+// each byte getting a short pulse every pass, see write_sweep(). The
+// data sheets want N passes of tPW, with N x tPW >= 100ms.
+#define SWEEP_PASSES 106           // N
+#define SWEEP_PULSE  950           // tPW in us, 100 to 1000us
+
 // cmds
 #define CMD_READ '1'               // Read from the EPROM
 #define CMD_WRTE '2'               // Program the EPROM
 #define CMD_CHEK '3'               // Check EPROM is blank (all FF))
 #define CMD_IDEN '4'               // Get the ID of the device ("8755")
 #define CMD_TYPE '5'               // Set the device type
+#define CMD_BMAP '6'               // Blank check all, return a map of non-blank
+#define CMD_STAT '7'               // Report (and reset) the counters
+#define CMD_BNCH '8'               // Benchmark the serial link
+#define CMD_VOTE 'M'               // Read n times, send the majority
+#define CMD_WLEN 'W'               // Program the EPROM, 4 digit length
 #define CMD_RSET '9'               // Reset the PIC
 #define CMD_INIT 'U'               // init the baud rate
+#define CMD_BTCH 'B'               // Run a list of cmds, see do_batch()
+#define CMD_SOFT 'S'               // Soft reset, keeping the baud rate
+#define CMD_PING 'P'               // Reply "OK", to check we're listening
+
+// Out of band, at any time: abort the running cmd, see isr(). ^X (CAN)
+// can't appear in a cmd or its hex data.
+#define CMD_ABRT 0x18
 
 // Received chars are put into a queue.
 // See e.g. Aho, Hopcroft & Ullman, 'Data structures and Algorithms'
@@ -47,17 +71,62 @@
 #define HIWATER   QUEUESIZE-32     // The highwater mark, stop sending.
 #define LOWATER   32               // The lowwater mark, resume sending.
 
+// The blank map has one bit per block of BLOCKSIZE bytes. Bits are sent
+// as hex, 8 blocks (128 bytes) per map byte, block 0 in bit 0.
+#define BLOCKSIZE 16               // Bytes per bit in the blank map
+#define MAPBLOCKS (BLOCKSIZE*8)    // Bytes covered by one map byte
+
+// Timer1 runs from Fosc/4 with a 1:8 prescale, so one tick is 1.6us.
+// The ISR counts overflows to extend it to 32 bits (about 115 minutes).
+#define TICK_NS   1600             // Length of a timer tick in ns
+#define NSTATS    12               // Max number of cmds with timing stats
+#define BENCH_TIMEOUT 312500UL     // 0.5s in ticks, give up on the host
+
+// Cmd parser states, see isr()
+#define PS_IDLE   0                // Waiting for a '$'
+#define PS_CMD    1                // Waiting for the cmd char
+#define PS_ARGS   2                // Collecting the cmd's arg chars
+#define PS_DATA   3                // Cmd running, chars go on the queue
+#define PS_LOAD   4                // Cmd running, hex loaded as bytes
+#define MAXARGS   8                // Max arg chars for a cmd
+
 //
 // static variables
 //
 static char    queue[QUEUESIZE];   // The receiver queue
 static int16_t head = 0;           // head of the queue
 static int16_t tail = ENDQUEUE;    // tail of the  queue
-static bool    cmd_active = false; // Are we in a cmd?
-static bool    queue_empty = false;// wait if queue empty
+static volatile bool cmd_active = false; // Are we in a cmd?
+static volatile bool aborted = false; // CMD_ABRT seen, until clear() replies
+static volatile uint8_t pstate = PS_IDLE; // cmd parser state
+static int8_t  cmd_idx = -1;       // the cmd found by the parser, in cmds[]
+static char    args[MAXARGS];      // the cmd's arg chars
+static uint8_t nargs = 0;          // arg chars received so far
 static int8_t  devType = 5;        // 5 = 8755, 6 = 8748
 static int16_t bytes = 1024;       // size of program data
 static bool    writing = false;    // are we programming?
+static bool    cmd_failed = false; // set by a cmd that fails, see fail()
+static bool    batching = false;   // running a list of cmds, see do_batch()
+static uint8_t batch_done = 0;     // cmds in the list that passed
+
+// Loading data into queue[] as bytes, for write_sweep(). See load_start()
+static int16_t  loaded = 0;        // bytes loaded
+static int16_t  load_len = 0;      // bytes wanted
+static volatile bool load_done = false; // all load_len bytes are in
+static uint8_t  load_hi = 0;       // the first hex digit of a byte
+static bool     load_odd = false;  // have we got the first digit?
+
+// Counters, reported by CMD_STAT
+static bool     cts = false;       // is CTS set (stop sending)?
+static uint16_t cts_stops = 0;     // times CTS set to stop the host
+static uint16_t drops = 0;         // chars dropped as the queue was full
+static int16_t  hiwater = 0;       // most chars ever in the queue
+static volatile uint16_t tmr_hi=0; // Timer1 overflows, hi word of ticks()
+static char     stat_cmd[NSTATS];  // the cmd timed
+static uint16_t stat_count[NSTATS];// times it was run
+static uint32_t stat_last[NSTATS]; // ticks taken by the last run
+static uint32_t stat_max[NSTATS];  // ticks taken by the longest run
+static uint32_t stat_total[NSTATS];// ticks taken by all runs
 
 // ****************************************************************************
 // setCTS()
@@ -65,20 +134,13 @@ static bool    writing = false;    // are we programming?
 //
 void setCTS(bool b)
 {
+    if (b && !cts) {
+        cts_stops++;
+    }
+    cts = b;
     PORTAbits.RA2 = b;
 }
 
-// ****************************************************************************
-// reset the queue
-//
-void clear()
-{
-    memset(queue, 0x00, QUEUESIZE);
-    head = 0;
-    tail = ENDQUEUE; 
-    cmd_active   = false;
-}
-
 // ****************************************************************************
 // Get the next position clockwise in array, handling begin/end of array.
 //
@@ -95,6 +157,10 @@ int16_t addone(int16_t i)
 int16_t size()
 {
     int16_t s = addone(tail) - head;
+    if (s < 0) {
+        // tail has wrapped round
+        s += QUEUESIZE;
+    }
     if (s > HIWATER) {
         setCTS(true);
     }
@@ -126,6 +192,10 @@ void push(char c)
 {    
     // If the queue is nearly full, set CTS.)
     int16_t s = addone(tail) - head;
+    if (s < 0) {
+        // tail has wrapped round
+        s += QUEUESIZE;
+    }
     if (s > HIWATER) {
         setCTS(true);
     }
@@ -135,6 +205,7 @@ void push(char c)
         
     if ( addone(addone(tail)) == head) {
         // error - queue is full. Flash red led.
+        drops++;
         LATEbits.LATE2 = 1;
         __delay_ms(100);
         LATEbits.LATE2 = 0;
@@ -143,6 +214,9 @@ void push(char c)
     else {
         tail = addone(tail);
         queue[tail] = c;
+        if (s >= hiwater) {
+            hiwater = s+1;
+        }
     }  
 }
 
@@ -153,12 +227,17 @@ void push(char c)
 // c = queue[0]
 // head = 1;
 // tail = 0; (note that now queue is empty as tail+1 == head))
+// Returns 0 if the cmd is aborted while waiting.
 //
 char pop()
 {
     // Check for empty. Do this before disabling interrupts
     // as need to receive chars still.
     while (empty()) {
+        if (aborted) {
+            return 0;
+        }
+
         // Wait for queue to fill, flash green led.
         LATEbits.LATE0 = 1;
         __delay_ms(100);
@@ -173,6 +252,9 @@ char pop()
     // Get the head of the queue.
     char c = queue[head];
     head = addone(head);
+
+    // Let the host send again once we're below the lowwater mark
+    size();
     
     // Enable interrupts
     INTCONbits.GIE = 1;
@@ -181,13 +263,6 @@ char pop()
     return c;
 }
 
-// ****************************************************************************
-// first - get the first char pushed on the queue, without removing it.
-char first()
-{
-    return queue[head];
-}
-
 // ****************************************************************************
 // convert char to hex digit. Handle upper and lower case.
 //
@@ -201,6 +276,162 @@ uint8_t charToHexDigit(char c)
     return c - '0';
 }
 
+// ****************************************************************************
+// Send a cmd's error message, and note it failed for do_batch().
+//
+void fail(const char* s)
+{
+    uart_puts(s);
+    cmd_failed = true;
+}
+
+// ****************************************************************************
+// Reverse queue[i..j], for load_start().
+//
+void reverse(int16_t i, int16_t j)
+{
+    while (i < j) {
+        char c = queue[i];
+        queue[i++] = queue[j];
+        queue[j--] = c;
+    }
+}
+
+// ****************************************************************************
+// Is the device an 8748 or 8749? Else it is wired as the 8755 is, with
+// the 27xx parts on an adapter that latches A0-7 from port D on ALE.
+//
+bool is_8748()
+{
+    return devType == DEV_8748 || devType == DEV_8749;
+}
+
+// ****************************************************************************
+// Is the device programmed in passes, see write_sweep()?
+//
+bool is_sweep()
+{
+    return devType == DEV_2708 || devType == DEV_T2716;
+}
+
+// ****************************************************************************
+// Add a hex digit to the bytes being loaded, see load_start().
+// Called with interrupts disabled.
+//
+void load_char(char c)
+{
+    if (loaded >= load_len) {
+        return;
+    }
+    if (load_odd) {
+        queue[loaded++] = (char) (load_hi*16 + charToHexDigit(c));
+        if (loaded == load_len) {
+            load_done = true;
+        }
+    }
+    else {
+        load_hi = charToHexDigit(c);
+    }
+    load_odd = !load_odd;
+}
+
+// ****************************************************************************
+// Start loading the next n bytes of hex data from the host into queue[],
+// as bytes. isr() loads them as they arrive, and sets load_done when all
+// are in. Any chars already on the queue come first. The queue is
+// rotated so they start at queue[0], then as each byte takes two chars
+// they can be converted in place.
+//
+void load_start(int16_t n)
+{
+    int16_t i, s;
+
+    INTCONbits.GIE = 0;
+    s = size();
+    if (head != 0) {
+        reverse(0, head - 1);
+        reverse(head, ENDQUEUE);
+        reverse(0, ENDQUEUE);
+    }
+    loaded = 0;
+    load_len = n;
+    load_done = false;
+    load_odd = false;
+    for (i = 0; i < s; ++i) {
+        load_char(queue[i]);
+    }
+    head = 0;
+    tail = ENDQUEUE;
+    pstate = PS_LOAD;
+    setCTS(false);
+    INTCONbits.GIE = 1;
+}
+
+// ****************************************************************************
+// Start Timer1 as a free running tick counter. See TICK_NS.
+//
+void timer_init(void)
+{
+    T1CON = 0b00110001;   // Fosc/4, 1:8 prescale, TMR1ON
+    TMR1H = 0;
+    TMR1L = 0;
+    tmr_hi = 0;
+    PIR1bits.TMR1IF = 0;
+    PIE1bits.TMR1IE = 1;  // overflow interrupt, see isr()
+}
+
+// ****************************************************************************
+// Get the 32 bit tick count. Called with interrupts enabled.
+//
+uint32_t ticks(void)
+{
+    uint8_t  th, tl;
+    uint16_t hi;
+
+    INTCONbits.GIE = 0;
+
+    // Re-read if TMR1L rolled over into TMR1H between the two reads
+    do {
+        th = TMR1H;
+        tl = TMR1L;
+    } while (th != TMR1H);
+    hi = tmr_hi;
+
+    // An overflow the isr hasn't counted yet
+    if (PIR1bits.TMR1IF && th < 0x80) {
+        hi++;
+    }
+
+    INTCONbits.GIE = 1;
+
+    return ((uint32_t) hi << 16) | ((uint16_t) th << 8) | tl;
+}
+
+// ****************************************************************************
+// Record the time taken by a cmd
+//
+void stat_time(char cmd, uint32_t t)
+{
+    uint8_t i;
+
+    // Find the cmd, or the first free slot.
+    for (i = 0; i < NSTATS; ++i) {
+        if (stat_cmd[i] == cmd || stat_cmd[i] == 0)
+            break;
+    }
+    if (i == NSTATS) {
+        return;
+    }
+
+    stat_cmd[i] = cmd;
+    stat_count[i]++;
+    stat_last[i] = t;
+    stat_total[i] += t;
+    if (t > stat_max[i]) {
+        stat_max[i] = t;
+    }
+}
+
 // ****************************************************************************
 // Initialise the ports
 //
@@ -267,13 +498,13 @@ void ports_init(void)
 }
 
 // ****************************************************************************
-// Set the device type and the RE0/1 bits
+// Set the device type, its size and the pins that depend on it. Returns
+// false if the type is unknown.
 //
-void
-do_type()
+bool set_type(int8_t type)
 {
-    devType = (int8_t) pop() - (int8_t) '0';
-            
+    devType = type;
+
     if (devType == DEV_8755) {
         bytes = 2048;          // 8755 has 2K EPROM
         LATAbits.LATA0 = 0;    // SEL
@@ -295,41 +526,36 @@ do_type()
         TRISBbits.TRISB2 = 1;  // PSEN is an O/P
         LATBbits.LATB2 = 0;    // RD_/PSEN
     }
+    else
+    if (devType >= DEV_2716 && devType <= DEV_T2716) {
+        // 27xx on its adapter, wired as the 8755
+        if (devType == DEV_2708)
+            bytes = 1024;      // 2708 is 1K
+        else if (devType == DEV_2732 || devType == DEV_2532)
+            bytes = 4096;      // 2732 and 2532 are 4K
+        else
+            bytes = 2048;      // 2716 and TMS2716 are 2K
+        LATAbits.LATA0 = 0;    // SEL
+        LATBbits.LATB5 = 0;    // RESET
+        TRISBbits.TRISB2 = 0;  // RD_ (OE_) is an O/P from PIC
+        LATBbits.LATB2 = 1;    // RD_ set false
+    }
     else {
-        uart_puts("bad type");
-        return;
+        return false;
     }
-    uart_puts("OK");
+    return true;
 }
 
 // ****************************************************************************
-// high priority service routine for UART receive
+// Set the device type and the RE0/1 bits
 //
-void __interrupt() isr(void)
+void
+do_type()
 {
-    char c = 0;
-
-    // Disable interrupts
-    INTCONbits.GIE = 0;
-    PIE1bits.RCIE=0;
-
-    // Get the character from uart
-    bool ok = uart_getc(&c);
-    if (ok) {
-        // Push the char onto stack
-        push(c);
-
-        // Check if we have a cmd yet. 
-        int16_t n = size();
-        if ( (first() == '$') && n > 1) {
-            // We have a command (2 chars at head of queue))
-            cmd_active = true;
-        }
-    }
-
-    // Enable interrupts
-    PIE1bits.RCIE=1;
-    INTCONbits.GIE = 1;
+    if (set_type((int8_t) args[0] - (int8_t) '0'))
+        uart_puts("OK");
+    else
+        fail("bad type");
 }
 
 // ****************************************************************************
@@ -348,19 +574,19 @@ void setup_address(uint16_t addr)
     // Set port D to output address
     TRISD = OUTPUT;
 
-    if (devType == DEV_8755) {
+    if (!is_8748()) {
         // Set _RD hi
         LATBbits.LATB2 = 1;
     }
 
-    // Set the address lines. D0-7 is A0-7, C0-2 is A8-10
+    // Set the address lines. D0-7 is A0-7, C0-3 is A8-11
     uint8_t hi = addr >> 8;
     LATD       = addr & 0x00ff;
     LATC       = hi;
     __delay_us(5);
 
-    // If we're an 8755
-    if (devType == DEV_8755) {
+    // If we're an 8755, or a 27xx whose adapter latches A0-7 the same way
+    if (!is_8748()) {
         // Set ALE hi; AD0-7,IO/_M. A8-10, CE2 and _CE1 enter latches
         LATBbits.LATB0 = 1;
         __delay_us(2);
@@ -387,8 +613,8 @@ uint8_t read_port()
     TRISD = INPUT;
     __delay_us(5);
     
-    // Set _RD_ lo to enable reading in 8755
-    if (devType == DEV_8755) {
+    // Set _RD_ lo to enable reading in 8755 (OE_ on a 27xx)
+    if (!is_8748()) {
         LATBbits.LATB2 = 0;
         __delay_us(1);
     }
@@ -401,7 +627,7 @@ uint8_t read_port()
     uint8_t data = PORTD;
 
     // Set _RD hi to disable reading in 8755
-    if (devType == DEV_8755) {
+    if (!is_8748()) {
         __delay_us(1);
         LATBbits.LATB2 = 1;
     }
@@ -417,6 +643,32 @@ uint8_t read_port()
     return data;
 }
 
+// ****************************************************************************
+// Read the byte at addr. Caller must have enabled the device (CE1_, CE2)
+//
+uint8_t read_addr(uint16_t addr)
+{
+    if (is_8748()) {
+        // Set RESET_ lo
+        LATBbits.LATB5 = 0;
+        // Set EA to read from program memory
+        LATAbits.LATA1 = 1;
+        // T0 hi (verify mode))
+        LATBbits.LATB4 = 1;
+    }
+
+    // Latch the 16 bit address.
+    setup_address(addr);
+
+    // Read port D
+    uint8_t data = read_port();
+
+    // clear EA
+    LATAbits.LATA1 = 0;
+
+    return data;
+}
+
 // ****************************************************************************
 // Init uart baud rate by waiting for a 'U' char
 //
@@ -449,35 +701,19 @@ void do_blank()
     LATBbits.LATB3 = 0;
         
     for (addr = 0; addr < bytes; ++addr) {
-        if (cmd_active == false) {
-            uart_puts("Check aborted\n");
-            return;
+        if (aborted) {
+            ok = false;
+            break;
         }
 
-        if (devType == DEV_8748 || devType == DEV_8749) {
-            // Set RESET_ lo
-            LATBbits.LATB5 = 0;
-            // Set EA to read from program memory
-            LATAbits.LATA1 = 1;
-            // T0 hi (verify mode))
-            LATBbits.LATB4 = 1;
-        }
-        
-        // Latch the 16 bit address.
-        setup_address(addr);
-        
-        // Read port D
-        uint8_t data = read_port();
-   
-        // clear EA
-        LATAbits.LATA1 = 0;
+        uint8_t data = read_addr(addr);
         
         if (data != 0xff) {
             uart_puts("Erase check fail at address ");
             sprintf(ads, "0x%04x = ", addr);
             uart_puts(ads);
             sprintf(ads, "0x%02x\n", data);
-            uart_puts(ads);
+            fail(ads);
             ok = false;
             break;
         }
@@ -491,6 +727,62 @@ void do_blank()
     }  
 }
 
+// ****************************************************************************
+// check the whole eprom in one pass and send a map of the non-blank blocks.
+// Each map bit covers BLOCKSIZE bytes and is set if any byte is not 0xff.
+// The map is sent as hex followed by a newline, then "OK" if the device
+// is blank, else the count of non-blank bytes.
+//
+void do_blank_map()
+{
+    uint16_t addr;
+    uint16_t count = 0;
+    uint8_t  map = 0;
+    char ads[32];
+        
+    // Set CE1_ lo - enabled
+    LATBbits.LATB4 = 0;    
+    // Set CE2 hi - enabled
+    LATBbits.LATB1 = 1;
+    // Set PGM lo - disabled
+    LATBbits.LATB3 = 0;
+        
+    for (addr = 0; addr < bytes; ++addr) {
+        if (aborted) {
+            break;
+        }
+
+        uint8_t data = read_addr(addr);
+        
+        if (data != 0xff) {
+            map |= 1 << ((addr / BLOCKSIZE) & 7);
+            count++;
+        }
+
+        // Send each map byte as soon as its 8 blocks are done
+        if ((addr % MAPBLOCKS) == MAPBLOCKS-1) {
+            sprintf(ads, "%02x", map);
+            uart_puts(ads);
+            map = 0;
+        }
+    }
+    
+    // Set CE2 lo - disable
+    LATBbits.LATB1 = 0;
+    
+    if (aborted) {
+        return;
+    }
+    uart_putc('\n');
+    if (count == 0) {
+        uart_puts("OK");
+    }
+    else {
+        sprintf(ads, "Erase check fail, %u bytes\n", count);
+        fail(ads);
+    }
+}
+
 // ****************************************************************************
 // read from eprom
 // Timing critical code. At 20MHz xtal clock, each instruction = 200nS
@@ -509,28 +801,89 @@ void do_read()
     LATBbits.LATB3 = 0;
         
     for (addr = 0; addr < bytes; ++addr) {
-        if (cmd_active == false) {
-            uart_puts("Read aborted\n");
-            return;
+        if (aborted) {
+            break;
         }
         
-        if (devType == DEV_8748 || devType == DEV_8749) {
-            // Set RESET_ lo
-            LATBbits.LATB5 = 0;
-            // Set EA to read from program memory
-            LATAbits.LATA1 = 1;
-            // T0 hi (verify mode))
-            LATBbits.LATB4 = 1;
-        }
+        uint8_t data = read_addr(addr);
         
-        // Latch the 16 bit address.
-        setup_address(addr);
+        // Write address
+        if (col == 0) {
+            sprintf(ads, "%04x: ", addr);
+            uart_puts(ads);
+        }
+        // Write data
+        sprintf(ads, "%02x", data);
+        uart_puts(ads);
+        if (col == 15) {
+            col = 0;
+            uart_putc('\n');
+        } else {
+            uart_putc(' ');
+            col++;
+        }
+    }
+    
+    // Set CE2 lo - disable
+    LATBbits.LATB1 = 0;
+}
+
+// ****************************************************************************
+// read from eprom, reading each address n times (the arg, '1'-'9').
+// Sends the bitwise majority of the reads in the same format as do_read(),
+// but with a '*' after any byte where the reads did not all agree. Ends
+// with the count of these marginal bytes, then "OK".
+//
+void do_read_vote()
+{
+    uint16_t addr;
+    char ads[24];
+    uint8_t col=0;
+    uint8_t ones[8];
+    uint8_t i, b;
+    uint16_t marginal = 0;
+    uint8_t n = args[0] - '0';
+
+    if (n < 1 || n > 9) {
+        fail("bad passes\n");
+        return;
+    }
     
-        // Read port D
-        uint8_t data = read_port();
+    // Set CE1_ lo - enabled
+    LATBbits.LATB4 = 0;    
+    // Set CE2 hi - enabled
+    LATBbits.LATB1 = 1;
+    // Set PGM lo - disabled
+    LATBbits.LATB3 = 0;
         
-        // clear EA
-        LATAbits.LATA1 = 0;
+    for (addr = 0; addr < bytes; ++addr) {
+        if (aborted) {
+            break;
+        }
+        
+        // Count the ones in each bit over n reads
+        uint8_t first = read_addr(addr);
+        bool agree = true;
+        for (b = 0; b < 8; ++b) {
+            ones[b] = (first >> b) & 1;
+        }
+        for (i = 1; i < n; ++i) {
+            uint8_t data = read_addr(addr);
+            if (data != first) {
+                agree = false;
+            }
+            for (b = 0; b < 8; ++b) {
+                ones[b] += (data >> b) & 1;
+            }
+        }
+
+        // Take the majority
+        uint8_t data = 0;
+        for (b = 0; b < 8; ++b) {
+            if (ones[b]*2 > n) {
+                data |= 1 << b;
+            }
+        }
         
         // Write address
         if (col == 0) {
@@ -540,6 +893,10 @@ void do_read()
         // Write data
         sprintf(ads, "%02x", data);
         uart_puts(ads);
+        if (!agree) {
+            uart_putc('*');
+            marginal++;
+        }
         if (col == 15) {
             col = 0;
             uart_putc('\n');
@@ -551,6 +908,13 @@ void do_read()
     
     // Set CE2 lo - disable
     LATBbits.LATB1 = 0;
+
+    if (aborted) {
+        return;
+    }
+    sprintf(ads, "Marginal %u\n", marginal);
+    uart_puts(ads);
+    uart_puts("OK");
 }
 
 // ****************************************************************************
@@ -610,33 +974,68 @@ void write_port(uint8_t data)
         LATBbits.LATB4 = 1;
     
     }
+    else if (devType == DEV_2716) {
+
+        // Vpp (25V) on, with OE_ hi
+        __delay_us(2);
+        LATBbits.LATB3 = 1;
+
+        // Activate PGM (CE_) pulse hi for 50mS
+        __delay_us(2);
+        LATBbits.LATB4 = 1;
+
+        __delay_ms(50);
+
+        // Deactivate PGM pulse
+        LATBbits.LATB4 = 0;
+        __delay_us(2);
+
+        // Vpp off
+        LATBbits.LATB3 = 0;
+        __delay_us(1);
+    }
+    else if (devType == DEV_2732 || devType == DEV_2532) {
+
+        // Vpp on, 21V on OE_/Vpp for the 2732, 25V on Vpp for the 2532
+        __delay_us(2);
+        LATBbits.LATB3 = 1;
+
+        // Activate CE_ (PD/PGM on the 2532) pulse lo for 50mS
+        __delay_us(2);
+        LATBbits.LATB4 = 0;
+
+        __delay_ms(50);
+
+        // Deactivate CE_ pulse
+        LATBbits.LATB4 = 1;
+        __delay_us(2);
+
+        // Vpp off
+        LATBbits.LATB3 = 0;
+        __delay_us(1);
+    }
+    else if (is_sweep()) {
+
+        // One pass's pulse on PROGRAM (26V), with CS_/WE at +12V
+        __delay_us(10);
+        LATBbits.LATB3 = 1;
+
+        __delay_us(SWEEP_PULSE);
+
+        LATBbits.LATB3 = 0;
+        __delay_us(2);
+    }
 }
 
 // ****************************************************************************
-// write to eprom
+// write size bytes of hex data from the queue to eprom, from address 0.
 // Timing critical code. At 20MHz xtal clock, each instruction = 200nS
 //
-void do_write()
+void write_data(uint16_t size)
 {
     uint16_t addr;
     char c;
     
-    // Set write mode
-    writing = true;
-    
-    // Set port D to output
-    TRISD = OUTPUT;
-        
-    // Wait for a couple of chars before starting write
-    __delay_ms(200);
-    
-    // Get the size of the data
-    c = pop();
-    uint8_t hi = charToHexDigit(c);
-    c = pop();
-    uint8_t lo = charToHexDigit(c);
-    uint16_t size = hi*16+lo;
-    
     // Set CE2 hi - enable
     LATBbits.LATB1 = 1;
     // Set _RD hi - disable
@@ -644,23 +1043,31 @@ void do_write()
     // Set PGM lo - disable
     LATBbits.LATB3 = 0;
     
-    if (devType == DEV_8748 || devType == DEV_8749) {
+    if (is_8748()) {
         // Set EA to hi
         LATAbits.LATA1 = 1;
     }
+    else if (devType == DEV_2716) {
+        // Set CE_/PGM lo, it is pulsed hi
+        LATBbits.LATB4 = 0;
+    }
+    else if (devType != DEV_8755) {
+        // Set CE_ (PD/PGM) hi, it is pulsed lo
+        LATBbits.LATB4 = 1;
+    }
         
     for (addr = 0; addr < size; addr++) {
-        if (cmd_active == false) {
-            uart_puts("Write aborted\n");
-            return;
-        }
-
         // Get two ascii chars from queue and convert to 8 bit data.
         c = pop();
         uint8_t hi = charToHexDigit(c);
         c = pop();
         uint8_t lo = charToHexDigit(c);
         uint8_t data = hi*16+lo;
+
+        // Stop between bytes, never part way through a pulse
+        if (aborted) {
+            break;
+        }
         
         // Latch the 16 bit address.
         setup_address(addr);
@@ -669,7 +1076,7 @@ void do_write()
         write_port(data);
     }
     
-    if (devType == DEV_8748 || devType == DEV_8749) {
+    if (is_8748()) {
         // Set EA to lo
         LATAbits.LATA1 = 0;
     }
@@ -680,9 +1087,530 @@ void do_write()
     // unset write mode
     writing = false;
     
+    if (!aborted) {
+        uart_puts("OK");
+    }
+}
+
+// ****************************************************************************
+// Program a 2708 class part. The data is loaded into the queue's buffer,
+// QUEUESIZE bytes at a time, and that is swept SWEEP_PASSES times from
+// RAM, so the host sends it only once. For a part bigger than the buffer
+// "More\n" asks the host for the next QUEUESIZE bytes once the last are
+// programmed. 0xff bytes need no pulses.
+//
+void write_sweep(uint16_t size)
+{
+    uint16_t base, addr, n;
+    uint8_t pass;
+
+    // Set CE2 hi - enable
+    LATBbits.LATB1 = 1;
+    // Set _RD hi - disable
+    LATBbits.LATB2 = 1;
+    // Set PGM lo - disable
+    LATBbits.LATB3 = 0;
+    // Set CS_/WE to +12V
+    LATBbits.LATB4 = 1;
+
+    for (base = 0; base < size && !aborted; base += QUEUESIZE) {
+        n = size - base;
+        if (n > QUEUESIZE) {
+            n = QUEUESIZE;
+        }
+        load_start(n);
+        if (base != 0) {
+            uart_puts("More\n");
+        }
+
+        // Wait for the data, green led on
+        LATEbits.LATE0 = 1;
+        while (!load_done && !aborted) {
+            __delay_us(100);
+        }
+        LATEbits.LATE0 = 0;
+
+        for (pass = 0; pass < SWEEP_PASSES && !aborted; ++pass) {
+            for (addr = 0; addr < n && !aborted; ++addr) {
+                uint8_t data = queue[addr];
+                if (data == 0xff) {
+                    continue;
+                }
+
+                // Latch the 16 bit address.
+                setup_address(base + addr);
+
+                // Pulse the byte
+                write_port(data);
+            }
+        }
+    }
+
+    // Set CE2 lo - disable
+    LATBbits.LATB1 = 0;
+    // Set CS_/WE lo
+    LATBbits.LATB4 = 0;
+
+    // unset write mode
+    writing = false;
+
+    if (!aborted) {
+        uart_puts("OK");
+    }
+}
+
+// ****************************************************************************
+// write to eprom. The data is preceded by a 2 hex digit size.
+//
+void do_write()
+{
+    char c;
+    
+    // Set write mode
+    writing = true;
+    
+    // Set port D to output
+    TRISD = OUTPUT;
+        
+    // Wait for a couple of chars before starting write
+    __delay_ms(200);
+    
+    // Get the size of the data
+    c = pop();
+    uint8_t hi = charToHexDigit(c);
+    c = pop();
+    uint8_t lo = charToHexDigit(c);
+    uint16_t size = hi*16+lo;
+
+    if (is_sweep()) {
+        write_sweep(size);
+    }
+    else {
+        write_data(size);
+    }
+}
+
+// ****************************************************************************
+// write to eprom. The arg is a 4 hex digit size, so the whole device can be
+// written (do_write() can only write up to 255 bytes).
+//
+void do_write_len()
+{
+    uint8_t i;
+    uint16_t size = 0;
+
+    for (i = 0; i < 4; ++i) {
+        size = size*16 + charToHexDigit(args[i]);
+    }
+    if (size > bytes) {
+        fail("bad size\n");
+        return;
+    }
+
+    // Set write mode
+    writing = true;
+    
+    // Set port D to output
+    TRISD = OUTPUT;
+
+    if (is_sweep()) {
+        write_sweep(size);
+    }
+    else {
+        write_data(size);
+    }
+}
+
+// ****************************************************************************
+// Report the counters, one "name value" per line, then "OK".
+// The arg is '0' to just report, '1' to report then reset the counters.
+// cmd lines give the times run and the last, max and total ticks.
+//
+void do_stat()
+{
+    char s[64];
+    uint8_t i;
+    char c = args[0];
+
+    sprintf(s, "tick_ns %u\n", TICK_NS);
+    uart_puts(s);
+    sprintf(s, "ferr %u\n", uart_ferr);
+    uart_puts(s);
+    sprintf(s, "oerr %u\n", uart_oerr);
+    uart_puts(s);
+    sprintf(s, "drops %u\n", drops);
+    uart_puts(s);
+    sprintf(s, "cts %u\n", cts_stops);
+    uart_puts(s);
+    sprintf(s, "hiwater %d\n", hiwater);
+    uart_puts(s);
+
+    for (i = 0; i < NSTATS && stat_cmd[i] != 0; ++i) {
+        sprintf(s, "cmd %c %u %lu %lu %lu\n", stat_cmd[i], stat_count[i],
+                (unsigned long) stat_last[i], (unsigned long) stat_max[i],
+                (unsigned long) stat_total[i]);
+        uart_puts(s);
+    }
+
+    if (c == '1') {
+        INTCONbits.GIE = 0;
+        uart_ferr = 0;
+        uart_oerr = 0;
+        drops = 0;
+        cts_stops = 0;
+        hiwater = 0;
+        INTCONbits.GIE = 1;
+        memset(stat_cmd, 0, sizeof(stat_cmd));
+        memset(stat_count, 0, sizeof(stat_count));
+        memset(stat_last, 0, sizeof(stat_last));
+        memset(stat_max, 0, sizeof(stat_max));
+        memset(stat_total, 0, sizeof(stat_total));
+    }
+
     uart_puts("OK");
 }
 
+// ****************************************************************************
+// Benchmark the serial link. The args are the mode and a 4 hex digit count.
+// 'S' sink     - receive count chars and throw them away
+// 'E' echo     - receive count chars and send each one back
+// 'T' transmit - send count chars 'A'-'Z' repeating
+// Replies with "chars errors ticks\n", where ticks is timed from the first
+// char received (or sent), 0 if none was, then "OK", or "Bench timeout\n"
+// if the host stops sending for 0.5s.
+//
+void do_bench()
+{
+    char s[32];
+    uint16_t i;
+    uint16_t n = 0;
+    uint32_t t;
+    uint32_t t0 = 0;
+    bool ok = true;
+    char mode = args[0];
+
+    if (mode != 'S' && mode != 'E' && mode != 'T') {
+        fail("bad bench mode");
+        return;
+    }
+    for (i = 1; i < 5; ++i) {
+        n = n*16 + charToHexDigit(args[i]);
+    }
+    uint16_t errs = uart_ferr + uart_oerr + drops;
+
+    if (mode == 'T') {
+        t0 = ticks();
+        for (i = 0; i < n && !aborted; ++i) {
+            uart_putc('A' + i%26);
+        }
+    }
+    else {
+        for (i = 0; i < n; ++i) {
+            // Wait for a char, give up if the host has stopped
+            t = ticks();
+            while (empty() && ok && !aborted) {
+                ok = (ticks() - t) < BENCH_TIMEOUT;
+            }
+            if (!ok || aborted) {
+                break;
+            }
+
+            char c = pop();
+            if (i == 0) {
+                t0 = ticks();
+            }
+            if (mode == 'E') {
+                uart_putc(c);
+            }
+        }
+    }
+    if (aborted) {
+        return;
+    }
+    t = i ? ticks() - t0 : 0;
+    errs = uart_ferr + uart_oerr + drops - errs;
+
+    sprintf(s, "%u %u %lu\n", i, errs, (unsigned long) t);
+    uart_puts(s);
+    if (ok) {
+        uart_puts("OK");
+    }
+    else {
+        fail("Bench timeout\n");
+    }
+}
+
+// ****************************************************************************
+// Reply to a 'U' once the baud rate is set
+//
+void do_already()
+{
+    uart_puts("Already init");
+}
+
+// ****************************************************************************
+// Send the ID of the device
+//
+void do_iden()
+{
+    if (devType >= 0 && devType < NDEVS)
+        uart_puts(dev_names[devType]);
+    else
+        fail("ERROR");
+}
+
+// ****************************************************************************
+// Reset the PIC
+//
+void do_reset()
+{
+    asm("RESET");
+}
+
+// ****************************************************************************
+// Soft reset: the pins and write mode back as they are at power on, and
+// the device type the 8755 as "$55" sets it, but the baud rate is kept, so
+// the host needn't send a 'U'. main() clears the queue after, as for any
+// cmd. The counters are kept.
+//
+void do_soft()
+{
+    ports_init();
+    set_type(DEV_8755);
+    writing = false;
+    uart_puts("OK");
+}
+
+// ****************************************************************************
+// Reply to a ping
+//
+void do_ping()
+{
+    uart_puts("OK");
+}
+
+// ****************************************************************************
+// Run a list of cmds back to back, with no round trips to the host. The
+// data is the cmds, each the cmd char and arg chars that would follow a
+// '$', then any data it takes, and a '.' to end. Each cmd's reply is sent
+// as it runs, and the list stops at the first that fails. Then "Done n\n",
+// where n is the number of cmds that passed.
+// main() runs them, see batch_next(), as the cmds can't call each other.
+// A write to a 2708 class part loads its data into the queue's buffer, so
+// the list ends after it.
+//
+void do_batch()
+{
+    batching = true;
+    batch_done = 0;
+    cmd_failed = false;
+}
+
+// ****************************************************************************
+// The cmds. A cmd is '$', the cmd char, then nargs arg chars which isr()
+// collects into args[] before the cmd is run. Any chars after that are
+// data, and go on the queue for the cmd to pop().
+//
+typedef struct {
+    char    cmd;                   // the cmd char
+    uint8_t nargs;                 // number of arg chars
+    void    (*fn)(void);           // does the cmd
+} cmd_t;
+
+static const cmd_t cmds[] = {
+    { CMD_READ, 0, do_read      },
+    { CMD_WRTE, 0, do_write     },
+    { CMD_CHEK, 0, do_blank     },
+    { CMD_IDEN, 0, do_iden      },
+    { CMD_TYPE, 1, do_type      },
+    { CMD_BMAP, 0, do_blank_map },
+    { CMD_STAT, 1, do_stat      },
+    { CMD_BNCH, 5, do_bench     },
+    { CMD_VOTE, 1, do_read_vote },
+    { CMD_WLEN, 4, do_write_len },
+    { CMD_RSET, 0, do_reset     },
+    { CMD_INIT, 0, do_already   },
+    { CMD_BTCH, 0, do_batch     },
+    { CMD_SOFT, 0, do_soft      },
+    { CMD_PING, 0, do_ping      },
+};
+#define NCMDS ((int8_t) (sizeof(cmds)/sizeof(cmds[0])))
+
+// ****************************************************************************
+// Find a cmd char in cmds[]. Returns the index, or -1 if not found.
+//
+int8_t cmd_find(char c)
+{
+    int8_t i;
+    for (i = 0; i < NCMDS; ++i) {
+        if (cmds[i].cmd == c)
+            return i;
+    }
+    return -1;
+}
+
+// ****************************************************************************
+// Parse a char of a cmd: the '$', the cmd char and its args. Once they are
+// all in, the cmd is active and what follows is its data.
+//
+void parse(char c)
+{
+    if (pstate == PS_IDLE) {
+        // Ignore anything outside a cmd
+        if (c == '$') {
+            pstate = PS_CMD;
+        }
+    }
+    else if (pstate == PS_CMD) {
+        cmd_idx = cmd_find(c);
+        nargs = 0;
+        if (cmd_idx < 0) {
+            // Unknown cmd. Start again, allowing for "$$"
+            pstate = (c == '$') ? PS_CMD : PS_IDLE;
+        }
+        else if (cmds[cmd_idx].nargs == 0) {
+            pstate = PS_DATA;
+            cmd_active = true;
+        }
+        else {
+            pstate = PS_ARGS;
+        }
+    }
+    else {
+        // PS_ARGS
+        args[nargs++] = c;
+        if (nargs == cmds[cmd_idx].nargs) {
+            pstate = PS_DATA;
+            cmd_active = true;
+        }
+    }
+}
+
+// ****************************************************************************
+// End the cmd: reset the parser and the queue, keeping only the next cmd.
+// Replies to a CMD_ABRT here, with interrupts off, so one that comes in
+// just as the cmd ends is still answered before aborted is cleared.
+//
+void clear()
+{
+    INTCONbits.GIE = 0;
+    if (aborted) {
+        uart_puts("Aborted\n");
+    }
+    pstate = PS_IDLE;
+    cmd_active   = false;
+    aborted = false;
+
+    // The host may send its next cmd as soon as it has the reply, before
+    // we get here, so it was queued as this cmd's data. Drop what's left
+    // of the data up to the '$', which hex data never has, and parse on
+    // from there.
+    while (!empty() && pstate != PS_DATA) {
+        parse(queue[head]);
+        head = addone(head);
+    }
+    if (empty()) {
+        head = 0;
+        tail = ENDQUEUE;
+        setCTS(false);
+    }
+    else {
+        size();
+    }
+    INTCONbits.GIE = 1;
+}
+
+// ****************************************************************************
+// Set up the next cmd of a batch in cmd_idx and args[], or end the batch.
+// Called by main() after each cmd while batching.
+//
+void batch_next()
+{
+    char s[16];
+    char c;
+    int8_t idx;
+    uint8_t i;
+    char last = cmds[cmd_idx].cmd;
+    bool more = !cmd_failed && !aborted;
+
+    if (last != CMD_BTCH && more) {
+        batch_done++;
+    }
+
+    // A write to a 2708 class part has used the queue's buffer
+    if (is_sweep() && (last == CMD_WRTE || last == CMD_WLEN)) {
+        more = false;
+    }
+
+    if (more) {
+        c = pop();
+        if (c != '.') {
+            idx = cmd_find(c);
+            if (idx < 0 || c == CMD_BTCH || c == CMD_RSET || c == CMD_INIT) {
+                fail("bad batch cmd\n");
+            }
+            else {
+                for (i = 0; i < cmds[idx].nargs; ++i) {
+                    args[i] = pop();
+                }
+                cmd_idx = idx;
+                return;
+            }
+        }
+    }
+
+    batching = false;
+    sprintf(s, "Done %u\n", batch_done);
+    uart_puts(s);
+}
+
+// ****************************************************************************
+// high priority service routine for UART receive
+// Parses cmds as they arrive, so main() only has to look at cmd_active.
+// A CMD_ABRT sets aborted, which the cmds check at each address, and
+// anything more is ignored until clear() has replied "Aborted\n".
+//
+void __interrupt() isr(void)
+{
+    char c = 0;
+
+    // The hardware clears GIE on the way in and RETFIE sets it again, so
+    // it is never touched here: setting it early would let a Timer1 or RX
+    // interrupt nest and overwrite the shadow registers.
+    PIE1bits.RCIE=0;
+
+    // Timer1 overflow, count the hi word of ticks()
+    if (PIR1bits.TMR1IF) {
+        PIR1bits.TMR1IF = 0;
+        tmr_hi++;
+    }
+
+    // Get the character from uart
+    bool ok = uart_getc(&c);
+    if (ok) {
+        if (aborted) {
+            // Wait for main() to finish the abort
+        }
+        else if (c == CMD_ABRT) {
+            aborted = true;
+            pstate = PS_IDLE;
+        }
+        else if (pstate == PS_DATA) {
+            // Data for the running cmd
+            push(c);
+        }
+        else if (pstate == PS_LOAD) {
+            // Data for write_sweep(), straight into its buffer
+            load_char(c);
+        }
+        else {
+            parse(c);
+        }
+    }
+
+    PIE1bits.RCIE=1;
+}
+
 // ****************************************************************************
 // main
 void main(void) {
@@ -696,6 +1624,9 @@ void main(void) {
     // Wait for a 'U' char to init the uart BRG
     do_init();
     
+    // Start the tick counter for the cmd timings
+    timer_init();
+    
     // Enable interrupts
     PIE1bits.RCIE=1;
     INTCONbits.GIE = 1;
@@ -708,57 +1639,30 @@ void main(void) {
             LATEbits.LATE0 = 0; // green off
             LATEbits.LATE1 = 1; // orange on
             
-            // pop the $
-            pop();
-            // and the cmd
-            char cmd = pop();
-            
-            // Do the cmd
-            if      (cmd == CMD_READ) {
-                do_read();
-            }
-            else if (cmd == CMD_WRTE) {
-                do_write();
-            }
-            else if (cmd == CMD_CHEK) {
-                do_blank();
-            }
-            else if (cmd == CMD_INIT) {
-                uart_puts("Already init");
-            }
-            else if (cmd == CMD_TYPE) {
-                do_type();
-            }
-            else if (cmd == CMD_IDEN) {
-                if (devType == 5)
-                    uart_puts("8755");
-                else if (devType == 6)
-                    uart_puts("8748");
-                else if (devType == 7)
-                    uart_puts("8749");
-                else
-                    uart_puts("ERROR");
-            }
-            else if (cmd == CMD_RSET) {
-                asm("RESET");
-            }
-            else if (cmd == CMD_RSET) {
-                asm("RESET");
+            // Do the cmd, and time it
+            uint32_t t = ticks();
+            cmds[cmd_idx].fn();
+            stat_time(cmds[cmd_idx].cmd, ticks() - t);
+
+            // The next cmd of a batch, if any
+            if (batching) {
+                batch_next();
             }
 
             // Clear the cmd
-            clear();
+            if (!batching) {
+                clear();
+            }
         } 
+        else if (aborted) {
+            // Nothing running, but the host still wants the reply
+            clear();
+        }
         else {
             // Green light to show we're ready
             LATEbits.LATE0 = 1; // green on
             LATEbits.LATE1 = 0; // orange off
         }
-        
-        // Delay for the loop
-        __delay_us(10);  
     } 
 }
 
-
-
@@ -16,6 +16,10 @@
 #include <stdarg.h>
 #include <string.h>
 
+// Receive error counts
+volatile uint16_t uart_ferr = 0;
+volatile uint16_t uart_oerr = 0;
+
 // ****************************************************************************
 // Function         [ uart_init ]
 // Description      [ ]
@@ -132,10 +136,12 @@ bool uart_getc(char *c)
     // Check for errors
     if (RCSTAbits.FERR) {
         uint8_t er = RCREG;    // Framing error
+        uart_ferr++;
     }
     else if (RCSTAbits.OERR) {
         RCSTAbits.CREN = 0;    // Overrun error, clear it
         RCSTAbits.CREN = 1;    // by toggling CREN
+        uart_oerr++;
     }
     else {
         if (PIR1bits.RCIF) {
@@ -170,7 +176,7 @@ void uart_putc(char c)
 // Function         [ uart_puts ]
 // Description      [ Send a null terminated string ]
 // ****************************************************************************
-void uart_puts(char *s)
+void uart_puts(const char *s)
 {
     // Wait until TXREG ready
     while (PIR1bits.TXIF == 0) {
@@ -178,7 +184,7 @@ void uart_puts(char *s)
     }
 
     // Put the char to send in transmit buffer
-    char *p = s;
+    const char *p = s;
     while (*p) {
         TXREG = *p++;
         while(TXSTAbits.TRMT == 0) {
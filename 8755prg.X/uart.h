@@ -22,6 +22,10 @@
 extern "C" {
 #endif
     
+// Receive error counts, see uart_getc()
+extern volatile uint16_t uart_ferr;    // framing errors
+extern volatile uint16_t uart_oerr;    // overrun errors
+
 // Initialise the UART
 void uart_init(const uint32_t baud_rate);
 
@@ -32,7 +36,7 @@ uint16_t uart_init_brg();
 void uart_putc(char c);
 
 // Send a string from the UART
-void uart_puts(char *s);
+void uart_puts(const char *s);
 
 // receive a char from the UART
 bool  uart_getc(char *c);
@@ -0,0 +1,25 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : baud.cpp
+// Environment          : Linux
+//
+// ****************************************************************************
+
+#include "baud.h"
+
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+
+// ****************************************************************************
+bool setOtherBaud(int fd, int baud)
+{
+    struct termios2 t;
+    if (ioctl(fd, TCGETS2, &t) < 0)
+        return false;
+    t.c_cflag &= ~CBAUD;
+    t.c_cflag |= BOTHER;
+    t.c_ispeed = baud;
+    t.c_ospeed = baud;
+    return ioctl(fd, TCSETS2, &t) == 0;
+}
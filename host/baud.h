@@ -0,0 +1,20 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : baud.h
+// Environment          : Linux
+//
+// Baud rates termios has no Bxxx for, such as 250000. Linux sets them with
+// termios2 and BOTHER, whose header clashes with <termios.h>, so they are
+// kept apart from serial.cpp.
+//
+// ****************************************************************************
+
+#ifndef BAUD_H
+#define BAUD_H
+
+// Set the port's speed both ways to baud. Returns false, with errno set,
+// if the driver won't.
+bool setOtherBaud(int fd, int baud);
+
+#endif // BAUD_H
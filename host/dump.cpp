@@ -0,0 +1,100 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : dump.cpp
+// Environment          : Linux
+//
+// ****************************************************************************
+
+#include "dump.h"
+
+#include <cstdio>
+
+// ****************************************************************************
+DumpParser::DumpParser(Image& img, size_t expected) :
+    m_img(img),
+    m_expected(expected),
+    m_count(0),
+    m_addr(0),
+    m_acc(0),
+    m_digits(0),
+    m_inLine(false),
+    m_done(false)
+{
+}
+
+// ****************************************************************************
+// Hex digits are collected until a separator. Four then ':' at the start
+// of a line is an address, two after it then ' ', '\n', '\r' or '*' is a
+// byte. Anything else is a message from the PIC, such as "Aborted", which
+// starts with hex digits and may come mid-line, and is an error before
+// any of it is taken as data.
+//
+size_t DumpParser::feed(const char* p, size_t n)
+{
+    size_t i;
+    for (i = 0; i < n && !m_done && m_error.empty(); ++i) {
+        char c = p[i];
+        int d = -1;
+        if (c >= '0' && c <= '9')
+            d = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            d = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            d = c - 'A' + 10;
+
+        if (d >= 0) {
+            m_acc = m_acc*16 + d;
+            m_digits++;
+            if (m_word.size() < 8)
+                m_word += c;
+            continue;
+        }
+
+        bool eol = (c == '\n' || c == '\r');
+        if (c == ':' && m_digits == 4 && !m_inLine) {
+            m_addr = m_acc;
+            m_inLine = true;
+        }
+        else if (m_inLine ? (eol || c == ' ' || c == '*')
+                          : (eol && m_digits == 0)) {
+            if (m_digits == 2 && m_inLine) {
+                if (m_addr >= m_img.size()) {
+                    char s[64];
+                    snprintf(s, sizeof(s),
+                             "address %04x beyond end of device", m_addr);
+                    m_error = s;
+                    break;
+                }
+                m_img.set(m_addr++, (uint8_t) m_acc);
+                m_count++;
+            }
+            else if (m_digits != 0) {
+                m_error = "bad dump near byte " + std::to_string(m_count);
+                break;
+            }
+        }
+        else {
+            // Not a dump line, or a message after the last byte
+            size_t end = i;
+            while (end < n && p[end] != '\n' && p[end] != '\r')
+                ++end;
+            m_error = "unexpected reply in dump: " + m_word +
+                      std::string(p + i, end - i);
+            break;
+        }
+        m_acc = 0;
+        m_digits = 0;
+        m_word.clear();
+        if (c == '\n')
+            m_inLine = false;
+
+        if (c == '*' && m_addr > 0) {
+            m_marginal.push_back((uint16_t) (m_addr-1));
+        }
+        else if (c == '\n' && m_count >= m_expected) {
+            m_done = true;
+        }
+    }
+    return i;
+}
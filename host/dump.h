@@ -0,0 +1,51 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : dump.h
+// Environment          : Linux
+//
+// Parse the dump sent by do_read() and do_read_vote() as it arrives:
+//   "0000: xx xx ... xx\n", 16 bytes a line, with a '*' after any byte the
+//   vote read found marginal.
+//
+// ****************************************************************************
+
+#ifndef DUMP_H
+#define DUMP_H
+
+#include "image.h"
+
+#include <string>
+#include <vector>
+
+class DumpParser
+{
+public:
+    // Parse expected bytes into img.
+    DumpParser(Image& img, size_t expected);
+
+    // Feed chars as they arrive. Returns how many were used, which is
+    // less than n once the dump is done. Check error() if it stops early.
+    size_t feed(const char* p, size_t n);
+
+    bool   done() const { return m_done; }
+    bool   failed() const { return !m_error.empty(); }
+    size_t count() const { return m_count; }
+    const std::vector<uint16_t>& marginal() const { return m_marginal; }
+    const std::string& error() const { return m_error; }
+
+private:
+    Image&   m_img;
+    size_t   m_expected;
+    size_t   m_count;              // bytes parsed
+    uint32_t m_addr;               // address of the next byte
+    uint32_t m_acc;                // hex digits so far
+    int      m_digits;             // number of them
+    bool     m_inLine;             // the line's address is in
+    std::string m_word;            // the hex digits so far, as sent
+    bool     m_done;
+    std::vector<uint16_t> m_marginal;
+    std::string m_error;
+};
+
+#endif // DUMP_H
@@ -0,0 +1,324 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : ihex.cpp
+// Environment          : Linux
+//
+// ****************************************************************************
+
+#include "ihex.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static const char hexChars[] = "0123456789ABCDEF";
+static const char hexLower[] = "0123456789abcdef";
+
+// ****************************************************************************
+// Value of each char as a hex digit, or -1.
+//
+struct HexTable
+{
+    int8_t v[256];
+    HexTable()
+    {
+        memset(v, -1, sizeof(v));
+        for (int i = 0; i < 10; ++i)
+            v['0'+i] = i;
+        for (int i = 0; i < 6; ++i) {
+            v['a'+i] = 10+i;
+            v['A'+i] = 10+i;
+        }
+    }
+};
+static const HexTable hexValue;
+
+// ****************************************************************************
+HexParser::HexParser(Image& img) :
+    m_img(img),
+    m_base(0),
+    m_line(0),
+    m_records(0),
+    m_eof(false),
+    m_ncarry(0)
+{
+}
+
+// ****************************************************************************
+bool HexParser::fail(const char* what)
+{
+    m_error = "line " + std::to_string(m_line) + ": " + what;
+    return false;
+}
+
+// ****************************************************************************
+// Whole lines are parsed where they are. Only a line split between feeds
+// is copied, into m_carry.
+//
+bool HexParser::feed(const char* p, size_t n)
+{
+    if (!m_error.empty())
+        return false;
+
+    while (n > 0) {
+        const char* nl = (const char*) memchr(p, '\n', n);
+        size_t len = nl ? (size_t) (nl - p) : n;
+
+        if (m_ncarry + len > MAXLINE)
+            return fail("record too long");
+
+        if (nl == nullptr) {
+            // Keep the start of the line for the next feed
+            memcpy(m_carry + m_ncarry, p, len);
+            m_ncarry += len;
+            return true;
+        }
+
+        bool ok;
+        if (m_ncarry > 0) {
+            memcpy(m_carry + m_ncarry, p, len);
+            ok = parseLine(m_carry, m_ncarry + len);
+            m_ncarry = 0;
+        }
+        else {
+            ok = parseLine(p, len);
+        }
+        if (!ok)
+            return false;
+
+        p += len + 1;
+        n -= len + 1;
+    }
+    return true;
+}
+
+// ****************************************************************************
+bool HexParser::finish()
+{
+    if (!m_error.empty())
+        return false;
+    if (m_ncarry > 0) {
+        size_t n = m_ncarry;
+        m_ncarry = 0;
+        return parseLine(m_carry, n);
+    }
+    return true;
+}
+
+// ****************************************************************************
+// Parse one record, without its '\n'.
+//
+bool HexParser::parseLine(const char* s, size_t n)
+{
+    ++m_line;
+    if (n > 0 && s[n-1] == '\r')
+        --n;
+    if (n == 0 || m_eof)
+        return true;
+    if (s[0] != ':')
+        return fail("missing ':'");
+    if ((n & 1) == 0 || n < 11)
+        return fail("bad length");
+
+    // Decode the bytes in place into rec, checking the sum as we go
+    uint8_t rec[260];
+    size_t  nrec = (n-1) / 2;
+    uint8_t sum = 0;
+    for (size_t i = 0; i < nrec; ++i) {
+        int hi = hexValue.v[(uint8_t) s[1+2*i]];
+        int lo = hexValue.v[(uint8_t) s[2+2*i]];
+        if ((hi | lo) < 0)
+            return fail("bad hex");
+        rec[i] = (uint8_t) (hi*16 + lo);
+        sum += rec[i];
+    }
+    if (nrec != (size_t) rec[0] + 5)
+        return fail("bad length");
+    if (sum != 0)
+        return fail("bad checksum");
+
+    uint8_t  len  = rec[0];
+    uint32_t addr = (rec[1] << 8) | rec[2];
+    uint8_t  type = rec[3];
+    ++m_records;
+
+    switch (type) {
+    case 0x00:
+        addr += m_base;
+        if (addr + len > m_img.size())
+            return fail("address beyond end of image");
+        memcpy(&m_img.data[addr], rec+4, len);
+        memset(&m_img.used[addr], 1, len);
+        break;
+    case 0x01:
+        m_eof = true;
+        break;
+    case 0x02:
+        if (len != 2)
+            return fail("bad segment address");
+        m_base = (uint32_t) ((rec[4] << 8) | rec[5]) << 4;
+        break;
+    case 0x04:
+        if (len != 2)
+            return fail("bad linear address");
+        m_base = (uint32_t) ((rec[4] << 8) | rec[5]) << 16;
+        break;
+    case 0x03:
+    case 0x05:
+        // Start addresses mean nothing to an EPROM
+        break;
+    default:
+        return fail("unknown record type");
+    }
+    return true;
+}
+
+// ****************************************************************************
+// Read the file in large blocks and feed them to a HexParser.
+//
+bool loadHex(const std::string& path, Image& img, std::string& err)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if (f == nullptr) {
+        err = path + ": cannot open";
+        return false;
+    }
+
+    HexParser parser(img);
+    std::vector<char> buf(1 << 16);
+    size_t n;
+    bool ok = true;
+    while (ok && (n = fread(buf.data(), 1, buf.size(), f)) > 0)
+        ok = parser.feed(buf.data(), n);
+    fclose(f);
+
+    if (ok)
+        ok = parser.finish();
+    if (!ok)
+        err = path + ": " + parser.error();
+    return ok;
+}
+
+// ****************************************************************************
+// Append a record, built on the stack.
+//
+static void putRecord(std::string& out, uint8_t type, uint16_t addr,
+                      const uint8_t* data, size_t n)
+{
+    char buf[1 + 2*(255+5) + 1];
+    char* p = buf;
+    uint8_t sum = n + (addr >> 8) + (addr & 0xff) + type;
+
+    *p++ = ':';
+    *p++ = hexChars[n >> 4];
+    *p++ = hexChars[n & 0x0f];
+    *p++ = hexChars[addr >> 12];
+    *p++ = hexChars[(addr >> 8) & 0x0f];
+    *p++ = hexChars[(addr >> 4) & 0x0f];
+    *p++ = hexChars[addr & 0x0f];
+    *p++ = hexChars[type >> 4];
+    *p++ = hexChars[type & 0x0f];
+    for (size_t i = 0; i < n; ++i) {
+        *p++ = hexChars[data[i] >> 4];
+        *p++ = hexChars[data[i] & 0x0f];
+        sum += data[i];
+    }
+    sum = -sum;
+    *p++ = hexChars[sum >> 4];
+    *p++ = hexChars[sum & 0x0f];
+    *p++ = '\n';
+    out.append(buf, p - buf);
+}
+
+// ****************************************************************************
+// Runs of used bytes go out as 16 byte records. A record never crosses
+// a 64K boundary, so an 04 record goes out whenever the top changes.
+//
+void writeHex(const Image& img, std::string& out)
+{
+    size_t   size = img.size();
+    uint32_t upper = 0;
+
+    // Room for a dense image, in full records. A sparse one has more,
+    // shorter records, and may need more.
+    out.reserve(out.size() + size/16*44 + 64);
+
+    size_t addr = 0;
+    while (addr < size) {
+        if (!img.used[addr]) {
+            ++addr;
+            continue;
+        }
+
+        size_t n = 0;
+        size_t limit = 0x10000 - (addr & 0xffff);
+        while (n < 16 && n < limit && addr+n < size && img.used[addr+n])
+            ++n;
+
+        if ((addr >> 16) != upper) {
+            upper = addr >> 16;
+            uint8_t ext[2] = { (uint8_t) (upper >> 8), (uint8_t) upper };
+            putRecord(out, 0x04, 0, ext, 2);
+        }
+        putRecord(out, 0x00, addr & 0xffff, &img.data[addr], n);
+        addr += n;
+    }
+    putRecord(out, 0x01, 0, nullptr, 0);
+}
+
+// ****************************************************************************
+bool saveHex(const std::string& path, const Image& img, std::string& err)
+{
+    std::string text;
+    writeHex(img, text);
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f == nullptr) {
+        err = path + ": cannot create";
+        return false;
+    }
+    bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok)
+        err = path + ": write failed";
+    return ok;
+}
+
+// ****************************************************************************
+void writeStream(const Image& img, size_t len, std::string& out)
+{
+    size_t base = out.size();
+    out.resize(base + 2*len);
+    char* p = &out[base];
+    for (size_t i = 0; i < len; ++i) {
+        *p++ = hexLower[img.data[i] >> 4];
+        *p++ = hexLower[img.data[i] & 0x0f];
+    }
+}
+
+// ****************************************************************************
+// 16 bytes a line, "%04x: " then "%02x" separated by ' ', ending '\n'.
+//
+void writeDump(const Image& img, std::string& out)
+{
+    size_t size = img.size();
+    size_t base = out.size();
+    out.resize(base + (size+15)/16*6 + size*3);
+    char* p = &out[base];
+
+    for (size_t a = 0; a < size; ++a) {
+        if ((a & 15) == 0) {
+            *p++ = hexLower[(a >> 12) & 0x0f];
+            *p++ = hexLower[(a >> 8) & 0x0f];
+            *p++ = hexLower[(a >> 4) & 0x0f];
+            *p++ = hexLower[a & 0x0f];
+            *p++ = ':';
+            *p++ = ' ';
+        }
+        *p++ = hexLower[img.data[a] >> 4];
+        *p++ = hexLower[img.data[a] & 0x0f];
+        *p++ = ((a & 15) == 15 || a+1 == size) ? '\n' : ' ';
+    }
+}
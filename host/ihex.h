@@ -0,0 +1,73 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : ihex.h
+// Environment          : Linux
+//
+// Intel HEX files, and the text formats the firmware uses: the hex char
+// stream do_write() pops and the "%04x: xx xx ..." dump do_read() sends
+// (parsed by DumpParser, see dump.h).
+//
+// ****************************************************************************
+
+#ifndef IHEX_H
+#define IHEX_H
+
+#include "image.h"
+
+#include <string>
+
+// Parse Intel HEX in one pass as the text arrives, with no allocation per
+// record. Data records go straight into the image, in any order. Extended
+// segment (02) and linear (04) address records are handled, start address
+// records (03, 05) are ignored.
+class HexParser
+{
+public:
+    explicit HexParser(Image& img);
+
+    // Feed text. Records may be split anywhere between calls.
+    // Returns false on the first bad record, see error().
+    bool feed(const char* p, size_t n);
+
+    // Call at the end of the text. Fails if a record is incomplete.
+    bool finish();
+
+    size_t records() const { return m_records; }
+    bool   sawEof() const { return m_eof; }
+    const std::string& error() const { return m_error; }
+
+private:
+    // A record is at most ':' + 2*(255+5) hex digits, and maybe a '\r'
+    enum { MAXLINE = 1 + 2*260 + 1 };
+
+    bool parseLine(const char* s, size_t n);
+    bool fail(const char* what);
+
+    Image&      m_img;
+    uint32_t    m_base;            // from 02 or 04 records
+    size_t      m_line;            // line number, for errors
+    size_t      m_records;
+    bool        m_eof;
+    char        m_carry[MAXLINE];  // a record split between feeds
+    size_t      m_ncarry;
+    std::string m_error;
+};
+
+// Load an Intel HEX file into img. Records outside the image are an error.
+bool loadHex(const std::string& path, Image& img, std::string& err);
+
+// Append the used bytes of img as Intel HEX, 16 byte records, with 04
+// records above 64K.
+void writeHex(const Image& img, std::string& out);
+
+// Save the used bytes of img as an Intel HEX file.
+bool saveHex(const std::string& path, const Image& img, std::string& err);
+
+// Append the first len bytes of img as the hex chars do_write() pops.
+void writeStream(const Image& img, size_t len, std::string& out);
+
+// Append img in the format do_read() sends.
+void writeDump(const Image& img, std::string& out);
+
+#endif // IHEX_H
@@ -0,0 +1,247 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : ihex_bench.cpp
+// Environment          : Linux
+//
+// Benchmark the Intel HEX and dump conversions over synthetic images:
+// many 2K device images at several sparsities, as in a batch job, and one
+// large image with extended addresses and its records out of order.
+// Each conversion is checked by a round trip.
+//
+//   ihex_bench [images] [large image MB]
+//
+// ****************************************************************************
+
+#include "dump.h"
+#include "ihex.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+static std::mt19937 rng(8755);
+
+// ****************************************************************************
+static double now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// ****************************************************************************
+// An image with roughly the given fraction left blank, in runs.
+//
+static Image makeImage(size_t size, double sparsity)
+{
+    Image img(size);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::uniform_int_distribution<int> run(1, 64);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+
+    size_t a = 0;
+    while (a < size) {
+        size_t n = std::min((size_t) run(rng), size - a);
+        bool blank = coin(rng) < sparsity;
+        for (size_t i = 0; i < n; ++i, ++a) {
+            if (!blank)
+                img.set(a, (uint8_t) byte(rng));
+        }
+    }
+    return img;
+}
+
+// ****************************************************************************
+static bool same(const Image& a, const Image& b)
+{
+    return a.data == b.data && a.used == b.used;
+}
+
+// ****************************************************************************
+// Reorder the records of hex text: the blocks that start with an 04 record
+// are shuffled, and the data records within each are reversed.
+//
+static std::string shuffleRecords(const std::string& text)
+{
+    std::vector<std::vector<std::string>> blocks(1);
+    std::string eof;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t nl = text.find('\n', pos);
+        std::string line = text.substr(pos, nl - pos + 1);
+        pos = nl + 1;
+        if (line.compare(7, 2, "04") == 0)
+            blocks.push_back(std::vector<std::string>());
+        if (line.compare(7, 2, "01") == 0)
+            eof = line;
+        else
+            blocks.back().push_back(line);
+    }
+
+    std::shuffle(blocks.begin(), blocks.end(), rng);
+    std::string out;
+    for (std::vector<std::string>& b : blocks) {
+        bool ext = !b.empty() && b[0].compare(7, 2, "04") == 0;
+        if (ext)
+            out += b[0];
+        else
+            // Data below 64K follows an explicit 04 record once shuffled
+            out += ":020000040000FA\n";
+        std::reverse(b.begin() + (ext ? 1 : 0), b.end());
+        for (size_t i = ext ? 1 : 0; i < b.size(); ++i)
+            out += b[i];
+    }
+    return out + eof;
+}
+
+// ****************************************************************************
+static void report(const char* what, size_t bytes, size_t records, double secs)
+{
+    printf("  %-22s %9.1f MB/s %12.0f records/s %8.2f ns/byte\n", what,
+           bytes / secs / 1e6, records / secs, secs * 1e9 / bytes);
+}
+
+// ****************************************************************************
+// Many 2K images, as a batch job would convert them.
+//
+static bool benchDevices(size_t count, double sparsity)
+{
+    std::vector<Image> imgs;
+    for (size_t i = 0; i < count; ++i)
+        imgs.push_back(makeImage(2048, sparsity));
+
+    printf("%zu x 2K images, %.0f%% blank\n", count, sparsity * 100);
+
+    // Intel HEX out
+    std::vector<std::string> texts(count);
+    size_t hexBytes = 0, records = 0;
+    double t = now();
+    for (size_t i = 0; i < count; ++i)
+        writeHex(imgs[i], texts[i]);
+    double secs = now() - t;
+    for (const std::string& s : texts) {
+        hexBytes += s.size();
+        records += std::count(s.begin(), s.end(), '\n');
+    }
+    report("writeHex", hexBytes, records, secs);
+
+    // Intel HEX in, fed a file block at a time
+    std::vector<Image> back(count, Image(2048));
+    t = now();
+    for (size_t i = 0; i < count; ++i) {
+        HexParser parser(back[i]);
+        const std::string& s = texts[i];
+        for (size_t pos = 0; pos < s.size(); pos += 4096)
+            parser.feed(s.data() + pos, std::min((size_t) 4096, s.size() - pos));
+        if (!parser.finish()) {
+            printf("HexParser: %s\n", parser.error().c_str());
+            return false;
+        }
+    }
+    secs = now() - t;
+    report("HexParser", hexBytes, records, secs);
+    for (size_t i = 0; i < count; ++i) {
+        if (!same(imgs[i], back[i])) {
+            printf("HexParser: image %zu differs after round trip\n", i);
+            return false;
+        }
+    }
+
+    // The do_write() stream
+    std::string stream;
+    stream.reserve(count * 4096);
+    t = now();
+    for (size_t i = 0; i < count; ++i)
+        writeStream(imgs[i], 2048, stream);
+    secs = now() - t;
+    report("writeStream", stream.size(), count, secs);
+
+    // The do_read() dump, out and back in as it would arrive
+    std::vector<std::string> dumps(count);
+    size_t dumpBytes = 0;
+    t = now();
+    for (size_t i = 0; i < count; ++i)
+        writeDump(imgs[i], dumps[i]);
+    secs = now() - t;
+    for (const std::string& s : dumps)
+        dumpBytes += s.size();
+    report("writeDump", dumpBytes, count * 128, secs);
+
+    t = now();
+    for (size_t i = 0; i < count; ++i) {
+        back[i] = Image(2048);
+        DumpParser parser(back[i], 2048);
+        const std::string& s = dumps[i];
+        for (size_t pos = 0; pos < s.size(); pos += 64)
+            parser.feed(s.data() + pos, std::min((size_t) 64, s.size() - pos));
+        if (!parser.done()) {
+            printf("DumpParser: %s\n", parser.error().c_str());
+            return false;
+        }
+    }
+    secs = now() - t;
+    report("DumpParser", dumpBytes, count * 128, secs);
+    for (size_t i = 0; i < count; ++i) {
+        if (imgs[i].data != back[i].data) {
+            printf("DumpParser: image %zu differs after round trip\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+// ****************************************************************************
+// One large image above 64K, read back with its records out of order.
+//
+static bool benchLarge(size_t mb)
+{
+    size_t size = mb << 20;
+    Image img = makeImage(size, 0.3);
+    printf("%zuMB image, 30%% blank, records out of order\n", mb);
+
+    std::string text;
+    double t = now();
+    writeHex(img, text);
+    double secs = now() - t;
+    size_t records = std::count(text.begin(), text.end(), '\n');
+    report("writeHex", text.size(), records, secs);
+
+    std::string shuffled = shuffleRecords(text);
+    Image back(size);
+    t = now();
+    HexParser parser(back);
+    for (size_t pos = 0; pos < shuffled.size(); pos += 65536)
+        parser.feed(shuffled.data() + pos,
+                    std::min((size_t) 65536, shuffled.size() - pos));
+    bool ok = parser.finish();
+    secs = now() - t;
+    if (!ok) {
+        printf("HexParser: %s\n", parser.error().c_str());
+        return false;
+    }
+    report("HexParser", shuffled.size(), parser.records(), secs);
+    if (!same(img, back)) {
+        printf("HexParser: large image differs after round trip\n");
+        return false;
+    }
+    return true;
+}
+
+// ****************************************************************************
+int main(int argc, char* argv[])
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 0) : 5000;
+    size_t mb    = argc > 2 ? strtoul(argv[2], nullptr, 0) : 16;
+
+    for (double sparsity : { 0.0, 0.5, 0.9 }) {
+        if (!benchDevices(count, sparsity))
+            return 1;
+    }
+    if (mb > 0 && !benchLarge(mb))
+        return 1;
+    return 0;
+}
@@ -0,0 +1,43 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : image.h
+// Environment          : Linux
+//
+// ****************************************************************************
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// An EPROM image. Bytes not set by a file or a read are 0xff (erased).
+struct Image
+{
+    std::vector<uint8_t> data;     // the bytes
+    std::vector<uint8_t> used;     // 1 if set by a file or a read
+
+    explicit Image(size_t n = 0) : data(n, 0xff), used(n, 0) {}
+
+    size_t size() const { return data.size(); }
+
+    void set(size_t addr, uint8_t b)
+    {
+        data[addr] = b;
+        used[addr] = 1;
+    }
+
+    // One past the last byte that is not 0xff, so trailing blank bytes
+    // need not be programmed.
+    size_t length() const
+    {
+        size_t n = data.size();
+        while (n > 0 && data[n-1] == 0xff)
+            --n;
+        return n;
+    }
+};
+
+#endif // IMAGE_H
@@ -0,0 +1,534 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : prg8755.cpp
+// Environment          : Linux
+//
+// Command line host for the programmer, for scripts and production use.
+// The cmds given are run in order on one connection, e.g.
+//   prg8755 -p /dev/ttyUSB0 -t 8755 job image.hex
+//
+// Given several ports (gang mode), each port gets its own thread running
+// the same cmds, so a tray of parts is programmed in parallel, e.g.
+//   prg8755 -p /dev/ttyUSB0,/dev/ttyUSB1,/dev/ttyUSB2 job image.hex
+// Output lines are prefixed with the port, and a status table follows.
+//
+// ^C aborts the cmd running on each PIC, so the station can be used again
+// at once, without a reset. A second ^C quits without waiting.
+//
+// A PIC still set up from the last run is soft reset, which keeps its baud
+// rate, so each part starts from a clean state without the wait for a
+// reset and auto baud.
+//
+// ****************************************************************************
+
+#include "ihex.h"
+#include "programmer.h"
+#include "serial.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static bool quiet = false;
+static bool gang  = false;         // more than one port
+static volatile sig_atomic_t stop = 0; // ^C, abort the cmds
+
+// One programmer, on one port
+struct Station
+{
+    std::string port;
+    Serial      serial;
+    Programmer  prg;
+    bool        ok;
+    std::string failed;            // the cmd that failed
+    double      secs;
+
+    explicit Station(const std::string& p) :
+        port(p), prg(serial), ok(false), secs(0) {}
+};
+
+// Output from the stations' threads, a line at a time
+static std::mutex outLock;
+
+// Images loaded so far, shared by the stations
+static std::mutex imageLock;
+static std::map<std::string, Image> images;
+
+// ****************************************************************************
+static void onSignal(int)
+{
+    stop = 1;
+}
+
+// ****************************************************************************
+static void usage()
+{
+    fprintf(stderr,
+        "usage: prg8755 [options] cmd [cmd...]\n"
+        "options:\n"
+        "  -p port[,port...]\n"
+        "                serial port(s) (default /dev/ttyUSB0). With more than\n"
+        "                one, the cmds run on all of them at once\n"
+        "  -b baud       baud rate (default 115200)\n"
+        "  -t type       device, 8755, 8748, 8749, 2716, 2732, 2532, 2708 or\n"
+        "                T2716 (default 8755)\n"
+        "  -n            no RTS/CTS flow control\n"
+        "  -q            no progress\n"
+        "cmds:\n"
+        "  id            show the device type set in the PIC\n"
+        "  blank         check the device is blank\n"
+        "  map           blank check all, show the non-blank 16 byte blocks\n"
+        "  read file     read the device to an Intel HEX file\n"
+        "  vote n file   read each byte n times, report marginal bytes\n"
+        "  write file    program an Intel HEX file\n"
+        "  verify file   compare the device with an Intel HEX file\n"
+        "  job file      blank, write and verify, run by the PIC as one batch\n"
+        "  stats         show the PIC's counters\n"
+        "  stats-reset   show the PIC's counters, then reset them\n"
+        "  bench m n     benchmark the link with n chars, m is S (sink),\n"
+        "                E (echo) or T (transmit)\n"
+        "  ping          check the PIC answers, with the round trip\n"
+        "  soft-reset    put the PIC as after a reset, keeping the baud rate\n"
+        "  reset         reset the PIC\n");
+    exit(2);
+}
+
+// ****************************************************************************
+static double now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// ****************************************************************************
+// printf to out, with the port first in gang mode.
+//
+static void say(const Station& st, FILE* out, const char* fmt, ...)
+{
+    std::lock_guard<std::mutex> lock(outLock);
+    if (gang)
+        fprintf(out, "%s: ", st.port.c_str());
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(out, fmt, ap);
+    va_end(ap);
+}
+
+// ****************************************************************************
+// Progress on one line, only with one port.
+//
+static Programmer::Progress progress(const char* what)
+{
+    if (quiet || gang)
+        return Programmer::Progress();
+    return [what](size_t done, size_t total) {
+        fprintf(stderr, "\r%s %zu/%zu", what, done, total);
+        if (done == total)
+            fprintf(stderr, "\n");
+    };
+}
+
+// ****************************************************************************
+static bool fail(Station& st, const char* what)
+{
+    say(st, stderr, "%s: %s\n", what, st.prg.error().c_str());
+    st.failed = what;
+    return false;
+}
+
+// ****************************************************************************
+// Load an image once, however many stations want it.
+//
+static bool loadImage(Station& st, const std::string& path, const Image*& img)
+{
+    std::lock_guard<std::mutex> lock(imageLock);
+    const Device& dev = *st.prg.device();
+    std::string key = path + "@" + dev.name;
+
+    auto it = images.find(key);
+    if (it == images.end()) {
+        Image loaded(dev.size);
+        std::string err;
+        if (!loadHex(path, loaded, err)) {
+            say(st, stderr, "%s\n", err.c_str());
+            st.failed = "load";
+            return false;
+        }
+        it = images.emplace(key, std::move(loaded)).first;
+    }
+    img = &it->second;
+    return true;
+}
+
+// ****************************************************************************
+static bool doBlank(Station& st)
+{
+    if (!st.prg.blank())
+        return fail(st, "blank");
+    say(st, stdout, "blank: OK\n");
+    return true;
+}
+
+// ****************************************************************************
+static bool doWrite(Station& st, const Image& img)
+{
+    if (!st.prg.write(img, progress("write")))
+        return fail(st, "write");
+    say(st, stdout, "write: OK, %zu bytes\n", img.length());
+    return true;
+}
+
+// ****************************************************************************
+static bool doVerify(Station& st, const Image& img)
+{
+    size_t bad = 0;
+    if (!st.prg.verify(img, bad, progress("verify")))
+        return fail(st, "verify");
+    say(st, stdout, "verify: OK\n");
+    return true;
+}
+
+// ****************************************************************************
+// The cmds, and how many args each takes.
+//
+static const struct
+{
+    const char* name;
+    size_t      args;
+} cmdList[] = {
+    { "id", 0 }, { "blank", 0 }, { "map", 0 }, { "read", 1 }, { "vote", 2 },
+    { "write", 1 }, { "verify", 1 }, { "job", 1 }, { "stats", 0 },
+    { "stats-reset", 0 }, { "bench", 2 }, { "ping", 0 }, { "soft-reset", 0 },
+    { "reset", 0 },
+};
+
+// ****************************************************************************
+// Check the cmds and their args, before any port is opened. Returns false,
+// having said what is wrong, if they are bad.
+//
+static bool checkCmds(const std::vector<std::string>& args)
+{
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& cmd = args[i];
+        size_t n = 0;
+        for (const auto& c : cmdList) {
+            if (cmd == c.name)
+                break;
+            ++n;
+        }
+        if (n == sizeof(cmdList) / sizeof(cmdList[0])) {
+            fprintf(stderr, "unknown cmd %s\n", cmd.c_str());
+            return false;
+        }
+        if (i + cmdList[n].args >= args.size()) {
+            fprintf(stderr, "%s needs %zu arg%s\n", cmd.c_str(),
+                    cmdList[n].args, cmdList[n].args > 1 ? "s" : "");
+            return false;
+        }
+
+        if (cmd == "vote") {
+            int passes = atoi(args[i+1].c_str());
+            if (passes < 1 || passes > 9) {
+                fprintf(stderr, "vote passes must be 1 to 9\n");
+                return false;
+            }
+        }
+        if (cmd == "bench") {
+            const std::string& mode = args[i+1];
+            unsigned long count = strtoul(args[i+2].c_str(), nullptr, 0);
+            if (mode != "S" && mode != "E" && mode != "T") {
+                fprintf(stderr, "bench mode must be S, E or T\n");
+                return false;
+            }
+            if (count == 0 || count > 0xffff) {
+                fprintf(stderr, "bench count must be 1 to 65535\n");
+                return false;
+            }
+        }
+        i += cmdList[n].args;
+    }
+    return true;
+}
+
+// ****************************************************************************
+// Run the cmds from args[i] on, checked by checkCmds(). Returns false at
+// the first failure.
+//
+static bool run(Station& st, const std::vector<std::string>& args)
+{
+    Programmer& prg = st.prg;
+
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& cmd = args[i];
+
+        if (cmd == "id") {
+            std::string id;
+            if (!prg.identify(id))
+                return fail(st, "id");
+            say(st, stdout, "id: %s\n", id.c_str());
+        }
+        else if (cmd == "blank") {
+            if (!doBlank(st))
+                return false;
+        }
+        else if (cmd == "map") {
+            std::string map;
+            bool ok = prg.blankMap(map);
+            say(st, stdout, "map: %s\n", map.c_str());
+            if (!ok)
+                return fail(st, "map");
+        }
+        else if (cmd == "read") {
+            Image img;
+            std::string err;
+            if (!prg.read(img, progress("read")))
+                return fail(st, "read");
+            if (!saveHex(args[++i], img, err)) {
+                say(st, stderr, "%s\n", err.c_str());
+                st.failed = "save";
+                return false;
+            }
+            say(st, stdout, "read: OK\n");
+        }
+        else if (cmd == "vote") {
+            int passes = atoi(args[++i].c_str());
+            Image img;
+            std::string err;
+            std::vector<uint16_t> marginal;
+            if (!prg.readVote(img, passes, marginal, progress("vote")))
+                return fail(st, "vote");
+            if (!saveHex(args[++i], img, err)) {
+                say(st, stderr, "%s\n", err.c_str());
+                st.failed = "save";
+                return false;
+            }
+            say(st, stdout, "vote: OK, %zu marginal\n", marginal.size());
+            for (uint16_t a : marginal)
+                say(st, stdout, "  %04x: %02x\n", a, img.data[a]);
+        }
+        else if (cmd == "write") {
+            const Image* img;
+            if (!loadImage(st, args[++i], img) || !doWrite(st, *img))
+                return false;
+        }
+        else if (cmd == "verify") {
+            const Image* img;
+            if (!loadImage(st, args[++i], img) || !doVerify(st, *img))
+                return false;
+        }
+        else if (cmd == "job") {
+            const Image* img;
+            std::string step;
+            if (!loadImage(st, args[++i], img))
+                return false;
+            bool ok = prg.job(*img, step, progress("job"));
+            if (step == "write" || step == "verify")
+                say(st, stdout, "blank: OK\n");
+            if (step == "verify")
+                say(st, stdout, "write: OK, %zu bytes\n", img->length());
+            if (!ok)
+                return fail(st, step.c_str());
+            say(st, stdout, "verify: OK\n");
+        }
+        else if (cmd == "stats" || cmd == "stats-reset") {
+            std::string text;
+            if (!prg.stats(cmd == "stats-reset", text))
+                return fail(st, "stats");
+            size_t pos = 0, nl;
+            while ((nl = text.find('\n', pos)) != std::string::npos) {
+                say(st, stdout, "%s\n", text.substr(pos, nl - pos).c_str());
+                pos = nl + 1;
+            }
+        }
+        else if (cmd == "bench") {
+            char mode = args[++i][0];
+            size_t count = strtoul(args[++i].c_str(), nullptr, 0);
+            BenchResult r;
+            if (!prg.bench(mode, count, r))
+                return fail(st, "bench");
+            say(st, stdout, "bench %c: %zu chars, %zu errors, %zu mismatches\n",
+                mode, r.chars, r.errors, r.mismatches);
+            say(st, stdout, "  pic  %.3fs, %.0f chars/s\n", r.picSecs,
+                r.picSecs > 0 ? r.chars / r.picSecs : 0.0);
+            say(st, stdout, "  host %.3fs, %.0f chars/s\n", r.hostSecs,
+                r.hostSecs > 0 ? r.chars / r.hostSecs : 0.0);
+            if (mode == 'E')
+                say(st, stdout, "  round trip min %.2fms avg %.2fms max %.2fms\n",
+                    r.minRtt*1e3, r.avgRtt*1e3, r.maxRtt*1e3);
+        }
+        else if (cmd == "ping") {
+            double t = now();
+            if (!prg.ping())
+                return fail(st, "ping");
+            say(st, stdout, "ping: OK, %.1fms\n", (now() - t) * 1e3);
+        }
+        else if (cmd == "soft-reset") {
+            const Device* dev = prg.device();
+            if (!prg.softReset() || !prg.setType(*dev))
+                return fail(st, "soft-reset");
+        }
+        else if (cmd == "reset") {
+            if (!prg.reset())
+                return fail(st, "reset");
+        }
+        else {
+            say(st, stderr, "unknown cmd %s\n", cmd.c_str());
+            st.failed = "usage";
+            return false;
+        }
+    }
+    return true;
+}
+
+// ****************************************************************************
+// Open the port, set up the PIC and run the cmds. Runs in its own thread
+// in gang mode.
+//
+static void station(Station& st, const Device& dev, int baud, bool rtscts,
+                    const std::vector<std::string>& args)
+{
+    double t = now();
+
+    if (!st.serial.open(st.port, baud, rtscts)) {
+        say(st, stderr, "%s\n", st.serial.error().c_str());
+        st.failed = "open";
+    }
+    else {
+        st.serial.setStop(&stop);
+        int brg;
+        if (!st.prg.init(&brg))
+            fail(st, "init");
+        else if (brg < 0 && !st.prg.softReset())
+            fail(st, "soft-reset");
+        else if (!st.prg.setType(dev))
+            fail(st, "type");
+        else
+            st.ok = run(st, args);
+    }
+
+    // Stop the PIC too, and wait for it to be ready again
+    if (stop && st.serial.isOpen()) {
+        st.serial.setStop(nullptr);
+        st.ok = false;
+        if (st.prg.abort())
+            say(st, stdout, "aborted\n");
+        else
+            fail(st, "abort");
+    }
+
+    st.serial.close();
+    st.secs = now() - t;
+}
+
+// ****************************************************************************
+// The status of each station, and the totals.
+//
+static void report(const std::vector<std::unique_ptr<Station>>& stations,
+                   double secs)
+{
+    size_t ok = 0;
+    printf("\n%-24s %-8s %8s\n", "port", "status", "secs");
+    for (const std::unique_ptr<Station>& st : stations) {
+        printf("%-24s %-8s %8.1f\n", st->port.c_str(),
+               st->ok ? "OK" : st->failed.c_str(), st->secs);
+        if (st->ok)
+            ok++;
+    }
+    printf("%zu OK, %zu failed, %.1fs, %.2f parts/min\n", ok,
+           stations.size() - ok, secs, secs > 0 ? ok * 60 / secs : 0.0);
+}
+
+
+// ****************************************************************************
+int main(int argc, char* argv[])
+{
+    std::string ports = "/dev/ttyUSB0";
+    std::string type = "8755";
+    int  baud = 115200;
+    bool rtscts = true;
+
+    int i;
+    for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+        const char* opt = argv[i];
+        bool hasArg = (strcmp(opt, "-p") == 0 || strcmp(opt, "-b") == 0 ||
+                       strcmp(opt, "-t") == 0);
+        if (hasArg && i+1 >= argc)
+            usage();
+        if (strcmp(opt, "-p") == 0)
+            ports = argv[++i];
+        else if (strcmp(opt, "-b") == 0)
+            baud = atoi(argv[++i]);
+        else if (strcmp(opt, "-t") == 0)
+            type = argv[++i];
+        else if (strcmp(opt, "-n") == 0)
+            rtscts = false;
+        else if (strcmp(opt, "-q") == 0)
+            quiet = true;
+        else
+            usage();
+    }
+    if (i >= argc)
+        usage();
+    std::vector<std::string> args(argv + i, argv + argc);
+    if (!checkCmds(args))
+        usage();
+
+    const Device* dev = findDevice(type);
+    if (dev == nullptr) {
+        fprintf(stderr, "unknown device type %s\n", type.c_str());
+        return 2;
+    }
+
+    std::vector<std::unique_ptr<Station>> stations;
+    size_t pos = 0;
+    while (pos <= ports.size()) {
+        size_t comma = ports.find(',', pos);
+        if (comma == std::string::npos)
+            comma = ports.size();
+        if (comma > pos)
+            stations.emplace_back(new Station(ports.substr(pos, comma - pos)));
+        pos = comma + 1;
+    }
+    if (stations.empty())
+        usage();
+    gang = stations.size() > 1;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onSignal;
+    sa.sa_flags = SA_RESETHAND;
+    sigaction(SIGINT, &sa, nullptr);
+
+    if (!gang) {
+        Station& st = *stations[0];
+        station(st, *dev, baud, rtscts, args);
+        return st.ok ? 0 : 1;
+    }
+
+    // A thread per port
+    double t = now();
+    std::vector<std::thread> threads;
+    for (std::unique_ptr<Station>& st : stations)
+        threads.emplace_back(station, std::ref(*st), std::cref(*dev), baud,
+                             rtscts, std::cref(args));
+    for (std::thread& th : threads)
+        th.join();
+
+    report(stations, now() - t);
+
+    for (const std::unique_ptr<Station>& st : stations) {
+        if (!st->ok)
+            return 1;
+    }
+    return 0;
+}
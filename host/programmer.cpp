@@ -0,0 +1,657 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : programmer.cpp
+// Environment          : Linux
+//
+// ****************************************************************************
+
+#include "programmer.h"
+#include "dump.h"
+#include "ihex.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Timeouts, in ms
+#define T_REPLY   2000             // a cmd's reply
+#define T_READ    5000             // gap between chars of a dump
+#define T_WRITE   60000            // margin on a write, see writeTimeout()
+#define T_IDLE    100              // end of a reply with no terminator
+#define T_ABORT   2000             // the PIC stopping its cmd
+#define T_INIT    750              // the PIC setting its baud rate, it
+                                   // looks for the 'U' every 500ms
+
+// Aborts the PIC's running cmd, see isr()
+#define ABORT     '\x18'
+
+// Chars sent to the PIC at a time while writing
+#define CHUNK     256
+
+// Bytes a 2708 class part is sent at a time, the PIC's buffer. Each byte
+// then takes up to SWEEP_MS per pass.
+#define SWEEP_BUF 1024
+#define SWEEP_MS  1.1
+
+// The other parts take a byte's 50ms program pulse, and the setup around
+// it, in up to PULSE_MS
+#define PULSE_MS  52
+
+static const Device devices[] = {
+    { "8755",  '5', 2048, 0 },
+    { "8748",  '6', 1024, 0 },
+    { "8749",  '7', 2048, 0 },
+    { "2716",  '0', 2048, 0 },
+    { "2732",  '1', 4096, 0 },
+    { "2532",  '2', 4096, 0 },
+    { "2708",  '3', 1024, 106 },
+    { "T2716", '4', 2048, 106 },
+};
+
+// ****************************************************************************
+const Device* findDevice(const std::string& name)
+{
+    for (const Device& d : devices) {
+        if (name == d.name)
+            return &d;
+    }
+    return nullptr;
+}
+
+// ****************************************************************************
+static double now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// ****************************************************************************
+Programmer::Programmer(Serial& port) :
+    m_port(port),
+    m_dev(&devices[0])
+{
+}
+
+// ****************************************************************************
+bool Programmer::send(const std::string& s)
+{
+    if (!m_port.write(s)) {
+        m_error = m_port.error();
+        return false;
+    }
+    return true;
+}
+
+// ****************************************************************************
+// Next char from the PIC, -1 on timeout, -2 on error.
+//
+int Programmer::getc(int timeoutMs)
+{
+    if (m_pending.empty()) {
+        char buf[256];
+        int n = m_port.read(buf, sizeof(buf), timeoutMs);
+        if (n < 0) {
+            m_error = m_port.error();
+            return -2;
+        }
+        if (n == 0)
+            return -1;
+        m_pending.assign(buf, n);
+    }
+    unsigned char c = m_pending[0];
+    m_pending.erase(0, 1);
+    return c;
+}
+
+// ****************************************************************************
+// Get a line from the PIC, without the '\n'. "OK" on its own counts as a
+// line as the PIC doesn't send a '\n' after it. If idleMs is given, a
+// pause that long also ends the line (for replies such as the ID).
+//
+bool Programmer::getLine(std::string& line, int timeoutMs, int idleMs)
+{
+    line.clear();
+    while (true) {
+        int t = (idleMs >= 0 && !line.empty()) ? idleMs : timeoutMs;
+        int c = getc(t);
+        if (c == -2)
+            return false;
+        if (c == -1) {
+            if (idleMs >= 0 && !line.empty())
+                return true;
+            m_error = line.empty() ? "no reply from the programmer"
+                                   : "incomplete reply: " + line;
+            return false;
+        }
+        if (c == '\n') {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            return true;
+        }
+        line += (char) c;
+        if (line == "OK")
+            return true;
+    }
+}
+
+// ****************************************************************************
+// Expect "OK". Anything else is the PIC's error message.
+//
+bool Programmer::expectOk(int timeoutMs)
+{
+    std::string line;
+    if (!getLine(line, timeoutMs))
+        return false;
+    if (line != "OK") {
+        m_error = line;
+        return false;
+    }
+    return true;
+}
+
+// ****************************************************************************
+// A reply to CMD_INIT, the PIC's baud rate generator value.
+//
+static bool isRate(const std::string& line)
+{
+    return !line.empty() && isdigit((unsigned char) line[0]);
+}
+
+// ****************************************************************************
+// Send a 'U', the only char the PIC's auto baud measures right. A PIC that
+// has just started replies with its rate, checking for the 'U' every
+// 500ms, and nothing more is sent until then, so its FIFO can't overrun
+// while it sets the rate. One that is running already ignores the 'U', as
+// it is outside a cmd. Either way a ping then checks the link.
+//
+bool Programmer::init(int* brg)
+{
+    std::string line;
+    int rate = -1;
+
+    m_port.flushInput();
+    m_pending.clear();
+    if (!send("U"))
+        return false;
+    if (getLine(line, T_INIT) && isRate(line))
+        rate = atoi(line.c_str());
+
+    if (!send("$P"))
+        return false;
+    while (getLine(line, T_REPLY)) {
+        if (line == "OK") {
+            if (brg != nullptr)
+                *brg = rate;
+            return true;
+        }
+        if (!isRate(line)) {
+            m_error = "unexpected reply to init: " + line;
+            return false;
+        }
+        // The rate, just too late
+        rate = atoi(line.c_str());
+    }
+    return false;
+}
+
+// ****************************************************************************
+bool Programmer::ping()
+{
+    return send("$P") && expectOk(T_REPLY);
+}
+
+// ****************************************************************************
+bool Programmer::setType(const Device& dev)
+{
+    if (!send(std::string("$5") + dev.code))
+        return false;
+    if (!expectOk(T_REPLY))
+        return false;
+    m_dev = &dev;
+    return true;
+}
+
+// ****************************************************************************
+bool Programmer::identify(std::string& id)
+{
+    if (!send("$4"))
+        return false;
+    return getLine(id, T_REPLY, T_IDLE);
+}
+
+// ****************************************************************************
+bool Programmer::blank()
+{
+    if (!send("$3"))
+        return false;
+    return expectOk(T_READ);
+}
+
+// ****************************************************************************
+bool Programmer::blankMap(std::string& map)
+{
+    if (!send("$6"))
+        return false;
+    if (!getLine(map, T_READ))
+        return false;
+    return expectOk(T_REPLY);
+}
+
+// ****************************************************************************
+// Send the hex data up to end. The driver holds us off while the PIC sets
+// CTS, so we just keep writing. In chunks only to report progress.
+//
+bool Programmer::sendHex(const std::string& data, size_t& sent, size_t end,
+                         const Progress& progress)
+{
+    while (sent < end) {
+        size_t n = std::min((size_t) CHUNK*2, end - sent);
+        if (!m_port.write(data.data() + sent, n)) {
+            m_error = m_port.error();
+            return false;
+        }
+        sent += n;
+        if (progress)
+            progress(sent/2, data.size()/2);
+    }
+    return true;
+}
+
+// ****************************************************************************
+// How long the PIC may take to finish a write once the host has sent the
+// last of its len bytes. The tty and usb-serial buffers take about 4K
+// chars whatever CTS says, so that may be long before the PIC has them:
+// all len of them may still be to program. A 2708 class part has at most
+// SWEEP_BUF, as it asks for the rest.
+//
+int Programmer::writeTimeout(size_t len) const
+{
+    if (m_dev->passes == 0)
+        return T_WRITE + (int) (len * PULSE_MS);
+    len = std::min(len, (size_t) SWEEP_BUF);
+    return T_WRITE + (int) (m_dev->passes * len * SWEEP_MS);
+}
+
+// ****************************************************************************
+// A 2708 class part asks for each SWEEP_BUF bytes after the first with
+// "More", once it has programmed the last.
+//
+bool Programmer::expectMore()
+{
+    std::string line;
+    if (!getLine(line, writeTimeout(SWEEP_BUF)))
+        return false;
+    if (line != "More") {
+        m_error = line;
+        return false;
+    }
+    return true;
+}
+
+// ****************************************************************************
+// Send "$W", the length, then the data as hex.
+//
+bool Programmer::write(const Image& img, const Progress& progress)
+{
+    size_t len = img.length();
+    if (len > m_dev->size) {
+        m_error = "image is larger than the device";
+        return false;
+    }
+    if (len == 0)
+        return true;
+
+    char cmd[8];
+    snprintf(cmd, sizeof(cmd), "$W%04x", (unsigned) len);
+    std::string data;
+    writeStream(img, len, data);
+    size_t part = m_dev->passes ? SWEEP_BUF*2 : data.size();
+
+    size_t sent = 0;
+    if (!send(cmd))
+        return false;
+    while (true) {
+        if (!sendHex(data, sent, std::min(sent + part, data.size()), progress))
+            return false;
+        if (sent == data.size())
+            break;
+        if (!expectMore())
+            return false;
+    }
+    return expectOk(writeTimeout(len));
+}
+
+// ****************************************************************************
+// Parse a dump as it arrives.
+//
+bool Programmer::readDump(Image& img, std::vector<uint16_t>* marginal,
+                          const Progress& progress)
+{
+    DumpParser parser(img, m_dev->size);
+    size_t lines = 0;
+
+    while (!parser.done()) {
+        if (m_pending.empty()) {
+            char buf[512];
+            int n = m_port.read(buf, sizeof(buf), T_READ);
+            if (n < 0) {
+                m_error = m_port.error();
+                return false;
+            }
+            if (n == 0) {
+                m_error = "read timed out after " +
+                          std::to_string(parser.count()) + " bytes";
+                return false;
+            }
+            m_pending.assign(buf, n);
+        }
+
+        size_t used = parser.feed(m_pending.data(), m_pending.size());
+        m_pending.erase(0, used);
+        if (parser.failed()) {
+            m_error = parser.error();
+            return false;
+        }
+        if (progress && parser.count()/16 != lines) {
+            lines = parser.count()/16;
+            progress(parser.count(), m_dev->size);
+        }
+    }
+
+    if (marginal != nullptr)
+        *marginal = parser.marginal();
+    return true;
+}
+
+// ****************************************************************************
+bool Programmer::read(Image& img, const Progress& progress)
+{
+    img = Image(m_dev->size);
+    if (!send("$1"))
+        return false;
+    return readDump(img, nullptr, progress);
+}
+
+// ****************************************************************************
+// The vote read ends with "Marginal n" then "OK".
+//
+bool Programmer::readVote(Image& img, int passes,
+                          std::vector<uint16_t>& marginal,
+                          const Progress& progress)
+{
+    if (passes < 1 || passes > 9) {
+        m_error = "passes must be 1 to 9";
+        return false;
+    }
+    img = Image(m_dev->size);
+    if (!send(std::string("$M") + (char) ('0' + passes)))
+        return false;
+    if (!readDump(img, &marginal, progress))
+        return false;
+
+    std::string line;
+    if (!getLine(line, T_REPLY))
+        return false;
+    return expectOk(T_REPLY);
+}
+
+// ****************************************************************************
+bool Programmer::verify(const Image& img, size_t& mismatches,
+                        const Progress& progress)
+{
+    Image got;
+    if (!read(got, progress))
+        return false;
+    return compare(img, got, mismatches);
+}
+
+// ****************************************************************************
+// Compare the used bytes of img with what was read.
+//
+bool Programmer::compare(const Image& img, const Image& got,
+                         size_t& mismatches)
+{
+    mismatches = 0;
+    for (size_t a = 0; a < img.size() && a < got.size(); ++a) {
+        if (img.used[a] && img.data[a] != got.data[a])
+            ++mismatches;
+    }
+    if (mismatches != 0) {
+        m_error = "verify failed, " + std::to_string(mismatches) +
+                  " bytes differ";
+        return false;
+    }
+    return true;
+}
+
+// ****************************************************************************
+// A batch ends with "Done n", n the cmds that passed. After a failure
+// skip to it.
+//
+bool Programmer::endBatch(size_t& done)
+{
+    std::string line;
+    while (getLine(line, T_REPLY)) {
+        if (line.compare(0, 5, "Done ") == 0) {
+            done = strtoul(line.c_str() + 5, nullptr, 10);
+            return true;
+        }
+    }
+    return false;
+}
+
+// ****************************************************************************
+// "$B", then blank (3), write (W, the length and data), read (1) and the
+// '.' that ends the batch, all sent at once. The replies come back in
+// order, so are read as for the separate cmds. A 2708 class part's write
+// ends the batch, as the PIC has used its queue for the data, so the
+// verify is a cmd of its own.
+//
+bool Programmer::job(const Image& img, std::string& step,
+                     const Progress& progress)
+{
+    size_t len = img.length();
+    size_t done = 0;
+    step = "load";
+    if (len > m_dev->size) {
+        m_error = "image is larger than the device";
+        return false;
+    }
+    if (len == 0) {
+        m_error = "image is blank";
+        return false;
+    }
+
+    char cmd[12];
+    snprintf(cmd, sizeof(cmd), "$B3W%04x", (unsigned) len);
+    std::string data;
+    writeStream(img, len, data);
+    size_t part = m_dev->passes ? SWEEP_BUF*2 : data.size();
+
+    size_t sent = 0;
+    step = "blank";
+    if (!send(cmd) || !sendHex(data, sent, std::min(part, data.size()), progress))
+        return false;
+    if (m_dev->passes == 0 && !send("1."))
+        return false;
+
+    if (!expectOk(T_READ)) {
+        std::string err = m_error;
+        endBatch(done);
+        m_error = err;
+        return false;
+    }
+
+    step = "write";
+    while (sent < data.size()) {
+        if (!expectMore() ||
+            !sendHex(data, sent, std::min(sent + part, data.size()), progress))
+            return false;
+    }
+    if (!expectOk(writeTimeout(len))) {
+        std::string err = m_error;
+        endBatch(done);
+        m_error = err;
+        return false;
+    }
+
+    step = "verify";
+    size_t mismatches;
+    if (m_dev->passes) {
+        if (!endBatch(done))
+            return false;
+        return verify(img, mismatches);
+    }
+    Image got(m_dev->size);
+    if (!readDump(got, nullptr, Progress()) || !endBatch(done))
+        return false;
+    return compare(img, got, mismatches);
+}
+
+// ****************************************************************************
+bool Programmer::stats(bool reset, std::string& text)
+{
+    if (!send(reset ? "$71" : "$70"))
+        return false;
+
+    text.clear();
+    std::string line;
+    while (getLine(line, T_REPLY)) {
+        if (line == "OK")
+            return true;
+        text += line + "\n";
+    }
+    return false;
+}
+
+// ****************************************************************************
+// Sink: send count chars. Echo: send them CHUNK at a time, reading each
+// chunk back to time the round trip. Transmit: read count chars.
+// The PIC then sends "chars errors ticks" and "OK".
+//
+bool Programmer::bench(char mode, size_t count, BenchResult& r)
+{
+    if (count == 0 || count > 0xffff) {
+        m_error = "count must be 1 to 65535";
+        return false;
+    }
+    if (mode != 'S' && mode != 'E' && mode != 'T') {
+        m_error = "mode must be S, E or T";
+        return false;
+    }
+    r = BenchResult();
+    r.minRtt = 1e9;
+
+    char cmd[12];
+    snprintf(cmd, sizeof(cmd), "$8%c%04x", mode, (unsigned) count);
+    if (!send(cmd))
+        return false;
+
+    std::string payload;
+    for (size_t i = 0; i < count; ++i)
+        payload += (char) ('A' + i%26);
+
+    double t0 = now();
+    if (mode == 'S') {
+        if (!send(payload))
+            return false;
+    }
+    else if (mode == 'E') {
+        size_t chunks = 0;
+        for (size_t i = 0; i < count; i += CHUNK) {
+            size_t n = std::min((size_t) CHUNK, count - i);
+            double t = now();
+            if (!m_port.write(payload.data() + i, n)) {
+                m_error = m_port.error();
+                return false;
+            }
+            for (size_t j = 0; j < n; ++j) {
+                int c = getc(T_REPLY);
+                if (c < 0) {
+                    if (c == -1)
+                        m_error = "echo timed out";
+                    return false;
+                }
+                if (c != payload[i+j])
+                    r.mismatches++;
+            }
+            double rtt = now() - t;
+            r.minRtt = std::min(r.minRtt, rtt);
+            r.maxRtt = std::max(r.maxRtt, rtt);
+            r.avgRtt += rtt;
+            ++chunks;
+        }
+        r.avgRtt /= chunks;
+    }
+    else {
+        for (size_t i = 0; i < count; ++i) {
+            int c = getc(T_REPLY);
+            if (c < 0) {
+                if (c == -1)
+                    m_error = "transmit timed out";
+                return false;
+            }
+            if (c != payload[i])
+                r.mismatches++;
+        }
+    }
+
+    // "chars errors ticks"
+    std::string line;
+    if (!getLine(line, T_READ))
+        return false;
+    r.hostSecs = now() - t0;
+    unsigned long chars, errors, ticks;
+    if (sscanf(line.c_str(), "%lu %lu %lu", &chars, &errors, &ticks) != 3) {
+        m_error = "bad bench reply: " + line;
+        return false;
+    }
+    r.chars = chars;
+    r.errors = errors;
+    r.picSecs = ticks * 1.6e-6;
+    if (mode != 'E')
+        r.minRtt = 0;
+    return expectOk(T_REPLY);
+}
+
+// ****************************************************************************
+// Whatever the PIC was sending, it ends "Aborted" once the cmd stops.
+// The line may have the start of a dump line in front.
+//
+bool Programmer::abort()
+{
+    std::string line;
+    m_pending.clear();
+    if (!m_port.sendNow(ABORT)) {
+        m_error = m_port.error();
+        return false;
+    }
+    while (getLine(line, T_ABORT)) {
+        if (line.size() >= 7 && line.compare(line.size() - 7, 7, "Aborted") == 0)
+            return true;
+    }
+    return false;
+}
+
+// ****************************************************************************
+bool Programmer::reset()
+{
+    m_pending.clear();
+    return send("$9");
+}
+
+// ****************************************************************************
+// The PIC's type after it is CMD_TYPE's power on default, the 8755.
+//
+bool Programmer::softReset()
+{
+    m_pending.clear();
+    if (!send("$S") || !expectOk(T_REPLY))
+        return false;
+    m_dev = &devices[0];
+    return true;
+}
@@ -0,0 +1,125 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : programmer.h
+// Environment          : Linux
+//
+// The cmds understood by the PIC (see main.c), over a Serial port.
+//
+// ****************************************************************************
+
+#ifndef PROGRAMMER_H
+#define PROGRAMMER_H
+
+#include "image.h"
+#include "serial.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// A device the PIC can program. code is the arg to CMD_TYPE.
+struct Device
+{
+    const char* name;
+    char        code;
+    size_t      size;
+    int         passes;            // 0, else programmed in passes from the
+                                   // PIC's buffer, see write_sweep()
+};
+
+// Find a device by name ("8755"), or nullptr.
+const Device* findDevice(const std::string& name);
+
+// The reply to CMD_BNCH, plus what the host saw.
+struct BenchResult
+{
+    size_t chars;                  // chars the PIC handled
+    size_t errors;                 // receive errors and drops on the PIC
+    double picSecs;                // time taken, by the PIC's ticks
+    double hostSecs;               // time taken, by the host's clock
+    double minRtt;                 // echo round trip per chunk, secs
+    double maxRtt;
+    double avgRtt;
+    size_t mismatches;             // echoed/sent chars that were wrong
+};
+
+class Programmer
+{
+public:
+    // Called with bytes done so far, and the total.
+    typedef std::function<void(size_t, size_t)> Progress;
+
+    explicit Programmer(Serial& port);
+
+    // Set the baud rate with a 'U', or check it was set already. brg
+    // is set to -1 if it was.
+    bool init(int* brg = nullptr);
+    // Check the PIC is there and idle.
+    bool ping();
+
+    bool setType(const Device& dev);
+    const Device* device() const { return m_dev; }
+    bool identify(std::string& id);
+
+    // Blank check. On failure error() has the PIC's message.
+    bool blank();
+    // Blank check all, map gets the hex map of non-blank 16 byte blocks.
+    bool blankMap(std::string& map);
+
+    // Write the image, from 0 up to the last byte that is not 0xff.
+    bool write(const Image& img, const Progress& progress = Progress());
+    // Read the device into img.
+    bool read(Image& img, const Progress& progress = Progress());
+    // Read each byte passes times, marginal gets the bytes that differed.
+    bool readVote(Image& img, int passes, std::vector<uint16_t>& marginal,
+                  const Progress& progress = Progress());
+    // Read the device and compare the used bytes of img.
+    bool verify(const Image& img, size_t& mismatches,
+                const Progress& progress = Progress());
+
+    // Blank check, write and verify, sent as one batch so the PIC runs
+    // them back to back. step is set to the one running, so on failure
+    // it is the one that failed, or "load" if the image can't be sent.
+    bool job(const Image& img, std::string& step,
+             const Progress& progress = Progress());
+
+    // The PIC's counters, one "name value" a line.
+    bool stats(bool reset, std::string& text);
+
+    // Benchmark the link, see do_bench(). mode is 'S', 'E' or 'T'.
+    bool bench(char mode, size_t count, BenchResult& r);
+
+    // Reset the PIC. It will need init() again.
+    bool reset();
+    // Put the pins and device type back as after a reset, but keep the
+    // baud rate, so no init() is needed. The type must be set again.
+    bool softReset();
+
+    // Abort the PIC's cmd, if any, see CMD_ABRT. Waits for the PIC to
+    // say it has stopped, so it is ready for the next cmd.
+    bool abort();
+
+    const std::string& error() const { return m_error; }
+
+private:
+    bool send(const std::string& s);
+    int  getc(int timeoutMs);
+    bool getLine(std::string& line, int timeoutMs, int idleMs = -1);
+    bool expectOk(int timeoutMs);
+    bool expectMore();
+    bool endBatch(size_t& done);
+    bool sendHex(const std::string& data, size_t& sent, size_t end,
+                 const Progress& progress);
+    int  writeTimeout(size_t len) const;
+    bool compare(const Image& img, const Image& got, size_t& mismatches);
+    bool readDump(Image& img, std::vector<uint16_t>* marginal,
+                  const Progress& progress);
+
+    Serial&       m_port;
+    const Device* m_dev;
+    std::string   m_pending;       // chars read but not used yet
+    std::string   m_error;
+};
+
+#endif // PROGRAMMER_H
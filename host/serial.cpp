@@ -0,0 +1,235 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : serial.cpp
+// Environment          : Linux
+//
+// ****************************************************************************
+
+#include "serial.h"
+#include "baud.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+// Longest wait without looking at the stop flag, in ms
+#define STOP_POLL 100
+
+// ****************************************************************************
+// Map a baud rate to a termios speed. Returns B0 if there is none, see
+// baud.h.
+//
+static speed_t toSpeed(int baud)
+{
+    switch (baud) {
+    case 9600:    return B9600;
+    case 19200:   return B19200;
+    case 38400:   return B38400;
+    case 57600:   return B57600;
+    case 115200:  return B115200;
+    case 230400:  return B230400;
+    case 460800:  return B460800;
+    case 500000:  return B500000;
+    case 921600:  return B921600;
+    case 1000000: return B1000000;
+    default:      return B0;
+    }
+}
+
+// ****************************************************************************
+Serial::Serial() : m_fd(-1), m_stop(nullptr)
+{
+}
+
+// ****************************************************************************
+Serial::~Serial()
+{
+    close();
+}
+
+// ****************************************************************************
+// Open the port raw, 8N1. A baud rate with no Bxxx is set after, see
+// baud.h.
+//
+bool Serial::open(const std::string& path, int baud, bool rtscts)
+{
+    close();
+
+    speed_t speed = toSpeed(baud);
+    if (baud <= 0) {
+        m_error = "unsupported baud rate " + std::to_string(baud);
+        return false;
+    }
+
+    m_fd = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (m_fd < 0) {
+        m_error = path + ": " + strerror(errno);
+        return false;
+    }
+
+    struct termios t;
+    if (tcgetattr(m_fd, &t) < 0) {
+        m_error = path + ": " + strerror(errno);
+        close();
+        return false;
+    }
+    cfmakeraw(&t);
+    cfsetispeed(&t, speed == B0 ? B38400 : speed);
+    cfsetospeed(&t, speed == B0 ? B38400 : speed);
+    t.c_cflag |= CLOCAL | CREAD;
+    t.c_cflag &= ~(CSTOPB | PARENB);
+    if (rtscts)
+        t.c_cflag |= CRTSCTS;
+    else
+        t.c_cflag &= ~CRTSCTS;
+    t.c_cc[VMIN]  = 0;
+    t.c_cc[VTIME] = 0;
+
+    if (tcsetattr(m_fd, TCSANOW, &t) < 0) {
+        m_error = path + ": " + strerror(errno);
+        close();
+        return false;
+    }
+    if (speed == B0 && !setOtherBaud(m_fd, baud)) {
+        m_error = path + ": baud rate " + std::to_string(baud) + ": " +
+                  strerror(errno);
+        close();
+        return false;
+    }
+    flushInput();
+    return true;
+}
+
+// ****************************************************************************
+void Serial::close()
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+// ****************************************************************************
+// Has the stop flag been set? If so that is the error.
+//
+bool Serial::stopped()
+{
+    if (m_stop == nullptr || !*m_stop)
+        return false;
+    m_error = "stopped";
+    return true;
+}
+
+// ****************************************************************************
+// Write all n chars. The driver holds them while CTS is set, so wait for
+// room when its buffer is full.
+//
+bool Serial::write(const char* p, size_t n)
+{
+    while (n > 0) {
+        if (stopped())
+            return false;
+        ssize_t w = ::write(m_fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN) {
+                struct pollfd pfd = { m_fd, POLLOUT, 0 };
+                poll(&pfd, 1, STOP_POLL);
+                continue;
+            }
+            m_error = std::string("write: ") + strerror(errno);
+            return false;
+        }
+        p += w;
+        n -= w;
+    }
+    return true;
+}
+
+// ****************************************************************************
+// With CTS set the driver won't send c, so flow control is off while it
+// goes. The PIC still takes it, see isr().
+//
+bool Serial::sendNow(char c)
+{
+    struct termios t, hold;
+    tcflush(m_fd, TCOFLUSH);
+    if (tcgetattr(m_fd, &t) < 0) {
+        m_error = std::string("tcgetattr: ") + strerror(errno);
+        return false;
+    }
+    hold = t;
+    t.c_cflag &= ~CRTSCTS;
+    tcsetattr(m_fd, TCSANOW, &t);
+
+    ssize_t w;
+    while ((w = ::write(m_fd, &c, 1)) < 0 && (errno == EINTR || errno == EAGAIN))
+        ;
+    tcdrain(m_fd);
+    tcsetattr(m_fd, TCSANOW, &hold);
+    if (w < 0) {
+        m_error = std::string("write: ") + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+// ****************************************************************************
+// Read what is available, waiting up to timeoutMs for something to arrive.
+//
+int Serial::read(char* p, size_t n, int timeoutMs)
+{
+    struct pollfd pfd;
+    pfd.fd = m_fd;
+    pfd.events = POLLIN;
+
+    int r;
+    do {
+        if (stopped())
+            return -1;
+        int t = timeoutMs;
+        if (m_stop != nullptr && (t < 0 || t > STOP_POLL))
+            t = STOP_POLL;
+        r = poll(&pfd, 1, t);
+        if (r < 0) {
+            if (errno == EINTR)
+                return stopped() ? -1 : 0;
+            m_error = std::string("poll: ") + strerror(errno);
+            return -1;
+        }
+        if (timeoutMs >= 0)
+            timeoutMs -= t;
+    } while (r == 0 && timeoutMs != 0);
+    if (r == 0)
+        return 0;
+
+    ssize_t got = ::read(m_fd, p, n);
+    if (got < 0) {
+        if (errno == EINTR || errno == EAGAIN)
+            return 0;
+        m_error = std::string("read: ") + strerror(errno);
+        return -1;
+    }
+    if (got == 0 && (pfd.revents & POLLHUP)) {
+        m_error = "read: hangup";
+        return -1;
+    }
+    return (int) got;
+}
+
+// ****************************************************************************
+void Serial::flushInput()
+{
+    tcflush(m_fd, TCIFLUSH);
+}
+
+// ****************************************************************************
+void Serial::drain()
+{
+    tcdrain(m_fd);
+}
@@ -0,0 +1,63 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : serial.h
+// Environment          : Linux
+//
+// A raw serial port using termios. Hardware flow control (CRTSCTS) lets
+// the driver hold off sending while the PIC has CTS set, see setCTS().
+//
+// ****************************************************************************
+
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <csignal>
+#include <cstddef>
+#include <string>
+
+class Serial
+{
+public:
+    Serial();
+    ~Serial();
+
+    // Open the port raw 8N1 at baud, with or without RTS/CTS.
+    bool open(const std::string& path, int baud, bool rtscts);
+    void close();
+    bool isOpen() const { return m_fd >= 0; }
+
+    // Write all n chars. Blocks while the PIC holds off with CTS.
+    bool write(const char* p, size_t n);
+    bool write(const std::string& s) { return write(s.data(), s.size()); }
+
+    // Send c now, dropping anything written but not yet sent, and
+    // whatever CTS says. For the PIC's abort char.
+    bool sendNow(char c);
+
+    // Read up to n chars, waiting up to timeoutMs for the first.
+    // Returns the number read, 0 on timeout, -1 on error.
+    int  read(char* p, size_t n, int timeoutMs);
+
+    // Give up any read or write, as an error, once *stop is set (e.g. by
+    // a SIGINT handler). nullptr for never.
+    void setStop(const volatile sig_atomic_t* stop) { m_stop = stop; }
+
+    // Throw away anything received but not read.
+    void flushInput();
+
+    // Wait until everything written has been sent.
+    void drain();
+
+    int  fd() const { return m_fd; }
+    const std::string& error() const { return m_error; }
+
+private:
+    bool stopped();
+
+    int         m_fd;
+    const volatile sig_atomic_t* m_stop;
+    std::string m_error;
+};
+
+#endif // SERIAL_H
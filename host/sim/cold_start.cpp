@@ -0,0 +1,138 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/cold_start.cpp
+// Environment          : Linux, g++
+//
+// Bring the simulated PIC up from cold with Programmer::init(), as prg8755
+// does after power on, over a pty at each baud rate. Then init() again,
+// warm, as for the next part, which must find the rate set. And check the
+// auto baud only takes a 'U': a PIC that gets "$P" first must not come up.
+//
+//   cold_start [baud...]
+//
+// Each case runs the firmware in its own process, so it starts afresh.
+//
+// ****************************************************************************
+
+#include "pic.h"
+#include "pty.h"
+#include "../programmer.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+static const int bauds[] = { 9600, 38400, 115200, 250000, 1000000 };
+
+// ****************************************************************************
+// Start the firmware on the pty. Returns its pid, or -1.
+//
+static pid_t startFirmware(int fd, int baud)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        PtyLink link(fd, baud);
+        Pic& pic = Pic::get();
+        pic.setLink(&link);
+        fw_main();
+        _exit(0);
+    }
+    if (pid < 0)
+        perror("fork");
+    return pid;
+}
+
+// ****************************************************************************
+static void stopFirmware(pid_t pid)
+{
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+}
+
+// ****************************************************************************
+// Run the cases at one rate. Returns the number that went wrong.
+//
+static int runBaud(int fd, const std::string& path, int baud)
+{
+    int bad = 0;
+    char name[32];
+
+    for (int probe = 0; probe < 2; ++probe) {
+        pid_t pid = startFirmware(fd, baud);
+        if (pid < 0)
+            return 1;
+
+        Serial port;
+        Programmer prg(port);
+        std::string result;
+        bool ok;
+        int brg = 0;
+        if (!port.open(path, baud, true)) {
+            result = port.error();
+            ok = false;
+        }
+        else if (probe) {
+            // The rate is wrong after the '$', so nothing gets through
+            bool up = port.write("$P") && prg.init(&brg);
+            ok = !up;
+            result = up ? "came up after a '$'" : "no init, as it should";
+        }
+        else if (!prg.init(&brg) || brg < 0) {
+            result = brg < 0 ? "rate was set already" : prg.error();
+            ok = false;
+        }
+        else {
+            snprintf(name, sizeof(name), "cold/%d", baud);
+            printf("%-20s OK, brg %d\n", name, brg);
+            ok = prg.init(&brg) && brg == -1;
+            result = ok ? "OK" : brg == -1 ? prg.error() : "rate set again";
+        }
+
+        snprintf(name, sizeof(name), "%s/%d", probe ? "probe" : "warm", baud);
+        printf("%-20s %s\n", name, result.c_str());
+        fflush(stdout);
+        if (!ok)
+            bad++;
+        port.close();
+        stopFirmware(pid);
+    }
+    return bad;
+}
+
+// ****************************************************************************
+int main(int argc, char* argv[])
+{
+    std::vector<int> rates;
+    for (int i = 1; i < argc; ++i) {
+        int baud = atoi(argv[i]);
+        if (baud <= 0) {
+            fprintf(stderr, "usage: cold_start [baud...]\n");
+            return 2;
+        }
+        rates.push_back(baud);
+    }
+    if (rates.empty())
+        rates.assign(bauds, bauds + sizeof(bauds)/sizeof(bauds[0]));
+
+    std::string path, err;
+    int slave;
+    int fd = openPty(path, slave, err);
+    if (fd < 0) {
+        fprintf(stderr, "%s\n", err.c_str());
+        return 1;
+    }
+
+    int bad = 0;
+    for (int baud : rates)
+        bad += runBaud(fd, path, baud);
+    printf("%d failed\n", bad);
+
+    close(slave);
+    close(fd);
+    return bad ? 1 : 0;
+}
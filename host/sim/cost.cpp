@@ -0,0 +1,95 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/cost.cpp
+// Environment          : Linux, g++
+//
+// What the firmware's own code costs, between the register accesses and
+// delays the simulated PIC sees. The firmware is built with
+// -finstrument-functions and -fsanitize-coverage=trace-pc, so each call,
+// return and basic block comes here, and is charged a fixed estimate of
+// the instructions XC8 makes of it. sprintf() is charged for the call,
+// its conversions and the chars it writes, as XC8's doprnt loops over
+// them. The cycles run at the firmware's next register access or delay,
+// see Pic::charge(), as the hooks can't throw SimDone.
+//
+// XC8's .lst would give per-function counts, but the one in dist/ is from
+// before most of the cmds, so these are estimates from its free mode code
+// for a PIC16.
+//
+// ****************************************************************************
+
+#include "pic.h"
+
+#include <cstdarg>
+#include <cstdio>
+
+// Cycles: a CALL and the moves of its args, a RETURN, and a basic block's
+// branch, bank selects and moves
+#define CALL_CYCLES   4
+#define RETURN_CYCLES 2
+#define BLOCK_CYCLES  4
+
+// sprintf (doprnt): the call, each conversion, and each char out
+#define SPRINTF_CALL  100
+#define SPRINTF_CONV  250
+#define SPRINTF_CHAR  40
+
+extern "C" {
+
+// ****************************************************************************
+// The -finstrument-functions hooks. The watcher, if any, is told first on
+// the way in and last on the way out, so the call is charged to the
+// function called.
+//
+__attribute__((no_instrument_function))
+void __cyg_profile_func_enter(void* fn, void*)
+{
+    Pic& pic = Pic::get();
+    if (pic.watcher())
+        pic.watcher()->enter(fn);
+    pic.charge(CALL_CYCLES);
+}
+
+__attribute__((no_instrument_function))
+void __cyg_profile_func_exit(void* fn, void*)
+{
+    Pic& pic = Pic::get();
+    pic.charge(RETURN_CYCLES);
+    if (pic.watcher())
+        pic.watcher()->exit(fn);
+}
+
+// ****************************************************************************
+// The -fsanitize-coverage=trace-pc hook, at the start of each basic block
+//
+void __sanitizer_cov_trace_pc()
+{
+    Pic::get().charge(BLOCK_CYCLES);
+}
+
+// ****************************************************************************
+// The firmware's sprintf() calls come here, with -Wl,--wrap=sprintf.
+//
+int __wrap_sprintf(char* s, const char* fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsprintf(s, fmt, ap);
+    va_end(ap);
+
+    unsigned convs = 0;
+    for (const char* p = fmt; *p; ++p) {
+        if (*p == '%' && p[1] != '%')
+            convs++;
+    }
+    Pic& pic = Pic::get();
+    if (pic.watcher())
+        pic.watcher()->enter((void*) __wrap_sprintf);
+    pic.charge(SPRINTF_CALL + convs * SPRINTF_CONV + n * SPRINTF_CHAR);
+    if (pic.watcher())
+        pic.watcher()->exit((void*) __wrap_sprintf);
+    return n;
+}
+
+}
@@ -0,0 +1,196 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/eprom.cpp
+// Environment          : Linux, g++
+//
+// ****************************************************************************
+
+#include "eprom.h"
+
+#include <cstring>
+#include <sys/mman.h>
+
+// The port bits, see ports_init()
+#define A_SEL   0x01               // port A
+#define A_EA    0x02
+#define A_PROG  0x10
+#define B_ALE   0x01               // port B
+#define B_CE2   0x02
+#define B_RD_   0x04
+#define B_VDD   0x08
+#define B_CE1_  0x10               // T0 on the 8748
+#define B_RESET 0x20
+
+#define PORT_A 0
+#define PORT_B 1
+#define PORT_C 2
+#define PORT_D 3
+
+// 2708 class parts: pulse time that programs a byte
+#define SWEEP_NS 100000000ull
+
+static const struct {
+    const char* name;
+    Eprom::Kind kind;
+    char        code;              // arg to CMD_TYPE, see main.c
+    size_t      size;
+} types[] = {
+    { "8755",  Eprom::E8755,  '5', 2048 },
+    { "8748",  Eprom::E8748,  '6', 1024 },
+    { "8749",  Eprom::E8749,  '7', 2048 },
+    { "2716",  Eprom::E2716,  '0', 2048 },
+    { "2732",  Eprom::E2732,  '1', 4096 },
+    { "2532",  Eprom::E2532,  '2', 4096 },
+    { "2708",  Eprom::E2708,  '3', 1024 },
+    { "T2716", Eprom::ET2716, '4', 2048 },
+};
+
+// ****************************************************************************
+// Make the (erased) memory, shared with any child processes.
+//
+bool Eprom::init(const char* type)
+{
+    size_t i;
+    for (i = 0; i < sizeof(types)/sizeof(types[0]); ++i) {
+        if (strcmp(type, types[i].name) == 0)
+            break;
+    }
+    if (i == sizeof(types)/sizeof(types[0]))
+        return false;
+    m_kind = types[i].kind;
+    m_code = types[i].code;
+    m_size = types[i].size;
+    if (m_kind == E2708 || m_kind == ET2716)
+        m_pulsed.assign(m_size, 0);
+
+    void* p = mmap(nullptr, m_size, PROT_READ|PROT_WRITE,
+                   MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return false;
+    m_mem = (uint8_t*) p;
+    memset(m_mem, 0xff, m_size);
+    return true;
+}
+
+// ****************************************************************************
+// SEL picks which socket the signals go to.
+//
+bool Eprom::selected(Pic& pic) const
+{
+    bool sel = (pic.lat(PORT_A) & A_SEL) != 0;
+    return sel == !is8755();
+}
+
+// ****************************************************************************
+// Look for the edges that latch an address or program a byte.
+//
+void Eprom::changed(Pic& pic)
+{
+    uint8_t a = pic.lat(PORT_A);
+    uint8_t b = pic.lat(PORT_B);
+    uint8_t fell_a = m_lata & ~a;
+    uint8_t fell_b = m_latb & ~b;
+    uint8_t rose_b = ~m_latb & b;
+    m_lata = a;
+    m_latb = b;
+
+    if (!selected(pic))
+        return;
+
+    uint16_t addr = pic.lat(PORT_D) | (pic.lat(PORT_C) & 0x0f) << 8;
+
+    if (m_kind == E8755) {
+        // ALE falling latches the address
+        if (fell_b & B_ALE)
+            m_addr = addr & (m_size - 1);
+
+        // The end of the 25V pulse with CE1 and CE2 hi programs the byte
+        if ((fell_b & B_VDD) && (b & B_CE1_) && (b & B_CE2)) {
+            m_mem[m_addr] &= pic.lat(PORT_D);
+            m_pulses++;
+        }
+    }
+    else if (is8755()) {
+        // The adapter's latch takes A0-7 as ALE falls
+        if (fell_b & B_ALE)
+            m_addr = addr & (m_size - 1);
+        changed27xx(fell_b, rose_b, b, pic);
+    }
+    else {
+        // RESET_ rising latches the address
+        if (rose_b & B_RESET)
+            m_addr = addr & (m_size - 1);
+
+        // The end of the PROG pulse with VDD hi and T0 lo programs it
+        if ((fell_a & A_PROG) && (b & B_VDD) && !(b & B_CE1_) && (a & A_EA)) {
+            m_mem[m_addr] &= pic.lat(PORT_D);
+            m_pulses++;
+        }
+    }
+}
+
+// ****************************************************************************
+// A 27xx programs at the end of its program pulse, with Vpp on.
+//
+void Eprom::changed27xx(uint8_t fell_b, uint8_t rose_b, uint8_t b, Pic& pic)
+{
+    uint8_t data = pic.lat(PORT_D);
+
+    if (m_kind == E2716) {
+        // PGM pulsed hi, OE_ hi
+        if ((fell_b & B_CE1_) && (b & B_VDD) && (b & B_RD_)) {
+            m_mem[m_addr] &= data;
+            m_pulses++;
+        }
+    }
+    else if (m_kind == E2732 || m_kind == E2532) {
+        // CE_ (PD/PGM) pulsed lo
+        if ((rose_b & B_CE1_) && (b & B_VDD)) {
+            m_mem[m_addr] &= data;
+            m_pulses++;
+        }
+    }
+    else {
+        // PROGRAM pulsed with CS_/WE at +12V. Enough of them program it.
+        if (rose_b & B_VDD)
+            m_pulseStart = pic.now();
+        if ((fell_b & B_VDD) && (b & B_CE1_)) {
+            m_pulses++;
+            m_pulsed[m_addr] += pic.now() - m_pulseStart;
+            if (m_pulsed[m_addr] >= SWEEP_NS) {
+                m_mem[m_addr] &= data;
+                m_pulsed[m_addr] = 0;
+            }
+        }
+    }
+}
+
+// ****************************************************************************
+// What the device drives onto the data bus, 0xff (pulled up) if nothing.
+//
+uint8_t Eprom::portD(Pic& pic)
+{
+    if (!selected(pic))
+        return 0xff;
+
+    uint8_t a = pic.lat(PORT_A);
+    uint8_t b = pic.lat(PORT_B);
+
+    if (m_kind == E8755) {
+        // RD_ lo, CE2 hi and CE1_ lo
+        if (!(b & B_RD_) && (b & B_CE2) && !(b & B_CE1_))
+            return m_mem[m_addr];
+    }
+    else if (is8755()) {
+        // OE_ (RD_) and CE_ lo, Vpp off
+        if (!(b & B_RD_) && !(b & B_CE1_) && !(b & B_VDD))
+            return m_mem[m_addr];
+    }
+    else {
+        // Verify mode, RESET_, T0 and EA hi
+        if ((b & B_RESET) && (b & B_CE1_) && (a & A_EA))
+            return m_mem[m_addr];
+    }
+    return 0xff;
+}
@@ -0,0 +1,75 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/eprom.h
+// Environment          : Linux, g++
+//
+// A pin level model of the device in the socket. It latches the address,
+// drives port D when read and programs on the programming pulse, from the
+// PIC's LAT and TRIS registers, as wired on the programmer board:
+//
+//   8755: RA0 SEL lo, RB0 ALE, RB1 CE2, RB2 RD_, RB3 VDD (25V), RB4 CE1_
+//   8748: RA0 SEL hi, RA1 EA, RA4 PROG, RB3 VDD, RB4 T0, RB5 RESET_
+//   27xx: RA0 SEL lo, RB0 ALE latches A0-7, RB2 RD_ is OE_ (and enables
+//         the data bus buffer), RB3 VDD switches Vpp, RB4 CE1_ is CE_
+//         (PGM on the 2716, PD/PGM on the 2532, CS_/WE on the 2708 and
+//         TMS2716, where hi is +12V for programming)
+//
+// The 2708 and TMS2716 need many short pulses: a byte is programmed once
+// its pulses add up to 100ms.
+//
+// The memory is shared, so it survives the firmware being reset.
+//
+// ****************************************************************************
+
+#ifndef SIM_EPROM_H
+#define SIM_EPROM_H
+
+#include "pic.h"
+
+#include <cstddef>
+#include <vector>
+
+#define SWEEP_BUF 1024             // the PIC's buffer, see write_sweep()
+
+class Eprom : public Pins
+{
+public:
+    enum Kind { E8755, E8748, E8749, E2716, E2732, E2532, E2708, ET2716 };
+
+    // type is e.g. "8755" or "T2716". Returns false if unknown.
+    bool init(const char* type);
+
+    Kind     kind() const { return m_kind; }
+    // The arg to CMD_TYPE for it
+    char     code() const { return m_code; }
+    // Programmed by the 8755's pins, not the 8748's
+    bool     is8755() const { return m_kind != E8748 && m_kind != E8749; }
+    // Programmed in passes from the PIC's buffer, SWEEP_BUF bytes at a time
+    bool     swept() const { return m_kind == E2708 || m_kind == ET2716; }
+    size_t   size() const { return m_size; }
+    uint8_t* data() { return m_mem; }
+
+    // Programming pulses seen
+    uint64_t pulses() const { return m_pulses; }
+
+    void    changed(Pic& pic) override;
+    uint8_t portD(Pic& pic) override;
+
+private:
+    bool selected(Pic& pic) const;
+    void changed27xx(uint8_t fell_b, uint8_t rose_b, uint8_t b, Pic& pic);
+
+    Kind     m_kind = E8755;
+    char     m_code = '5';
+    size_t   m_size = 0;
+    uint8_t* m_mem = nullptr;
+    uint16_t m_addr = 0;           // the latched address
+    uint8_t  m_lata = 0;           // the latches last time
+    uint8_t  m_latb = 0;
+    uint64_t m_pulses = 0;
+    simtime_t m_pulseStart = 0;    // when Vpp went on
+    std::vector<simtime_t> m_pulsed; // 2708: pulse time so far, by address
+};
+
+#endif // SIM_EPROM_H
@@ -0,0 +1,130 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/fault.cpp
+// Environment          : Linux, g++
+//
+// ****************************************************************************
+
+#include "fault.h"
+
+#include <cstdlib>
+
+#define ABORT 0x18                 // CMD_ABRT
+
+// ****************************************************************************
+bool Faults::parse(const std::string& spec, std::string& err)
+{
+    size_t pos = 0;
+    while (pos < spec.size()) {
+        size_t comma = spec.find(',', pos);
+        if (comma == std::string::npos)
+            comma = spec.size();
+        std::string item = spec.substr(pos, comma - pos);
+        pos = comma + 1;
+
+        size_t eq = item.find('=');
+        std::string name = item.substr(0, eq);
+        const char* val = eq == std::string::npos ? "" : item.c_str() + eq + 1;
+        char* end;
+        double v = strtod(val, &end);
+        if (*val == 0 || *end != 0 || v < 0) {
+            err = "bad fault " + item;
+            return false;
+        }
+        if (name == "ferr")
+            ferr = v;
+        else if (name == "oerr")
+            oerr = v;
+        else if (name == "lost")
+            lost = v;
+        else if (name == "dup")
+            dup = v;
+        else if (name == "cts")
+            cts = (unsigned) v;
+        else if (name == "seed")
+            seed = (unsigned) v;
+        else {
+            err = "unknown fault " + name;
+            return false;
+        }
+    }
+    return true;
+}
+
+// ****************************************************************************
+FaultLink::FaultLink(Link& host, const Faults& faults) :
+    m_host(host),
+    m_faults(faults),
+    m_rng(faults.seed),
+    m_uniform(0.0, 1.0)
+{
+}
+
+// ****************************************************************************
+bool FaultLink::hit(double chance)
+{
+    return chance > 0 && m_uniform(m_rng) < chance;
+}
+
+// ****************************************************************************
+void FaultLink::note(uint64_t& count, simtime_t now)
+{
+    count++;
+    if (m_counts.first == 0)
+        m_counts.first = now;
+}
+
+// ****************************************************************************
+// The host's char, maybe with a fault. While CTS is newly set the host
+// doesn't know yet, so gets m_faults.cts more chars out.
+//
+int FaultLink::hostChar(simtime_t now, bool cts)
+{
+    if (!m_armed)
+        return m_host.hostChar(now, cts);
+
+    if (cts && !m_cts)
+        m_late = m_faults.cts;
+    m_cts = cts;
+
+    if (m_dup >= 0) {
+        int c = m_dup;
+        m_dup = -1;
+        return c;
+    }
+
+    int c = m_host.hostChar(now, cts && m_late == 0);
+    if (c < 0 || c == ABORT)
+        return c;
+    if (cts) {
+        m_late--;
+        note(m_counts.cts, now);
+    }
+
+    if (hit(m_faults.ferr)) {
+        note(m_counts.ferr, now);
+        return c | LINK_FERR;
+    }
+    if (hit(m_faults.lost)) {
+        note(m_counts.lost, now);
+        return c | LINK_LOST;
+    }
+    if (hit(m_faults.dup)) {
+        note(m_counts.dup, now);
+        m_dup = c;
+    }
+    if (hit(m_faults.oerr)) {
+        note(m_counts.oerr, now);
+        return c | LINK_LATE;
+    }
+    return c;
+}
+
+// ****************************************************************************
+void FaultLink::ready(simtime_t now)
+{
+    if (m_armOnReady)
+        m_armed = true;
+    m_host.ready(now);
+}
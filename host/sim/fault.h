@@ -0,0 +1,91 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/fault.h
+// Environment          : Linux, g++
+//
+// Faults on the line from the host to the PIC, to see how the firmware
+// and host cope, and what it costs. A FaultLink sits between the PIC and
+// the host end (a ScriptLink, or the pty in prgemu) and, with the given
+// chance for each char:
+//   ferr  it arrives with a framing error
+//   oerr  the isr is held off, so the FIFO overruns if more follow
+//   lost  it never arrives
+//   dup   it arrives twice
+// cts is how many more chars the host sends after the PIC sets CTS, as a
+// USB serial adapter does. The abort char is left alone, so the host can
+// always get the PIC back.
+//
+// A spec is e.g. "ferr=1e-3,cts=8,seed=2".
+//
+// ****************************************************************************
+
+#ifndef SIM_FAULT_H
+#define SIM_FAULT_H
+
+#include "pic.h"
+
+#include <random>
+#include <string>
+
+struct Faults
+{
+    double   ferr = 0;
+    double   oerr = 0;
+    double   lost = 0;
+    double   dup = 0;
+    unsigned cts = 0;
+    unsigned seed = 1;
+
+    // Returns false, with err set, if the spec is bad.
+    bool parse(const std::string& spec, std::string& err);
+};
+
+// What was injected
+struct FaultCounts
+{
+    uint64_t ferr = 0;
+    uint64_t oerr = 0;
+    uint64_t lost = 0;
+    uint64_t dup = 0;
+    uint64_t cts = 0;              // chars sent after CTS was set
+    simtime_t first = 0;           // when the first was, 0 if none
+
+    uint64_t total() const { return ferr + oerr + lost + dup + cts; }
+};
+
+class FaultLink : public Link
+{
+public:
+    FaultLink(Link& host, const Faults& faults);
+
+    // Faults only happen while armed. With armOnReady they start once
+    // the firmware first gets to its main loop, after the auto baud 'U'.
+    void arm(bool on) { m_armed = on; }
+    void armOnReady() { m_armOnReady = true; }
+
+    const FaultCounts& counts() const { return m_counts; }
+
+    int  hostChar(simtime_t now, bool cts) override;
+    void picChar(simtime_t now, uint8_t c) override { m_host.picChar(now, c); }
+    void idle(simtime_t now) override { m_host.idle(now); }
+    void ready(simtime_t now) override;
+    int  baud() const override { return m_host.baud(); }
+
+private:
+    bool hit(double chance);
+    void note(uint64_t& count, simtime_t now);
+
+    Link&        m_host;
+    Faults       m_faults;
+    FaultCounts  m_counts;
+    bool         m_armed = false;
+    bool         m_armOnReady = false;
+    bool         m_cts = false;    // CTS last time
+    unsigned     m_late = 0;       // chars still to send after CTS set
+    int          m_dup = -1;       // the char to send again
+    std::mt19937 m_rng;
+    std::uniform_real_distribution<double> m_uniform;
+};
+
+#endif // SIM_FAULT_H
@@ -0,0 +1,286 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/fault_bench.cpp
+// Environment          : Linux, g++
+//
+// What link faults cost. Each case writes a whole device with faults on
+// the line to the PIC (see sim/fault.h), then reads it back as the host's
+// verify does, several times with different seeds. For each it reports
+// the faults injected and those the PIC counted (ferr, oerr and drops),
+// the runs that failed, how many bytes were mis-programmed, and the time
+// from the first fault to the PIC being ready again with the host knowing
+// the part is bad.
+//
+// The host gives up on a write as prg8755 does, once the PIC has been
+// quiet for its write timeout, and then aborts the cmd.
+//
+//   fault_bench [-n runs] [-s ms] [-F faults] [case...]
+//
+// -s is the host's timeout (default 60000, as T_WRITE), -F runs just
+// those faults. Cases are picked by prefix, e.g. "8755/200000".
+//
+// ****************************************************************************
+
+#include "eprom.h"
+#include "fault.h"
+#include "pic.h"
+#include "script.h"
+#include "../ihex.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+static const char* devices[] = { "8755", "2708" };
+// Up to what the isr keeps up with, see fw_bench, so the faults are the
+// injected ones
+static const int   bauds[] = { 115200, 200000 };
+static const char* faultSpecs[] = {
+    "ferr=1e-3", "oerr=1e-3", "lost=1e-3", "dup=1e-3", "cts=3", "cts=40"
+};
+
+#define SWEEP_PASSES 106           // as in main.c
+#define SWEEP_MS     1.1           // as in programmer.cpp
+#define PULSE_MS     52            // as in programmer.cpp
+
+// What one run did
+struct Run
+{
+    bool     done;                 // no step timed out
+    uint64_t faults;               // injected
+    uint64_t counted;              // ferr + oerr + drops, as the PIC saw
+    uint64_t misprog;              // bytes not as in the image
+    bool     stalled;              // the host had to abort the write
+    double   recoverMs;            // first fault to the PIC ready, with
+                                   // the host knowing; 0 if no harm done
+};
+
+struct Case
+{
+    std::string name;              // e.g. "8755/115200/ferr=1e-3"
+    std::string device;
+    int         baud;
+    std::string faults;
+};
+
+// ****************************************************************************
+static std::vector<Case> allCases(const std::vector<std::string>& specs)
+{
+    std::vector<Case> cases;
+    for (const char* dev : devices) {
+        for (int baud : bauds) {
+            for (const std::string& spec : specs) {
+                Case c;
+                c.device = dev;
+                c.baud = baud;
+                c.faults = spec;
+                c.name = c.device + "/" + std::to_string(baud) + "/" + spec;
+                cases.push_back(c);
+            }
+        }
+    }
+    return cases;
+}
+
+// ****************************************************************************
+// A PIC counter from the stats reply, e.g. "ferr 2".
+//
+static uint64_t counter(const std::string& stats, const char* name)
+{
+    std::string key = std::string(name) + " ";
+    size_t pos = stats.find(key);
+    if (pos == std::string::npos)
+        return 0;
+    return strtoull(stats.c_str() + pos + key.size(), nullptr, 10);
+}
+
+// ****************************************************************************
+// One run, in a child process as the firmware's statics can't be reset.
+//
+static Run runOnce(const Case& c, unsigned seed, double stallMs)
+{
+    Run r = { false, 0, 0, 0, false, 0 };
+    Eprom eprom;
+    eprom.init(c.device.c_str());
+
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> byte(0, 255);
+    Image img(eprom.size());
+    for (size_t a = 0; a < eprom.size(); ++a)
+        img.set(a, (uint8_t) byte(rng));
+
+    Faults faults;
+    std::string err;
+    faults.parse(c.faults, err);
+    faults.seed = seed;
+
+    // As prg8755 sends them: the write, then the verify's read
+    ScriptLink script(c.baud);
+    script.add("init", "U");
+    script.add("type", std::string("$5") + eprom.code());
+    char head[8];
+    snprintf(head, sizeof(head), "$W%04x", (unsigned) img.length());
+    std::string s = head;
+    writeStream(img, img.length(), s);
+    std::vector<size_t> holds;
+    for (size_t a = SWEEP_BUF; eprom.swept() && a < img.length(); a += SWEEP_BUF)
+        holds.push_back(strlen(head) + a*2);
+    script.add("write", s, holds);
+    script.add("verify", "$1");
+    script.add("stats", "$70");
+
+    // The host's timeout, see Programmer::writeTimeout()
+    if (eprom.swept())
+        stallMs += SWEEP_PASSES * SWEEP_BUF * SWEEP_MS;
+    else
+        stallMs += img.length() * PULSE_MS;
+    script.setStall((simtime_t) (stallMs * 1e6));
+
+    // Faults on the write only
+    FaultLink link(script, faults);
+    script.onStep([&](const Step& st) { link.arm(st.name == "write"); });
+
+    Pic& pic = Pic::get();
+    pic.setLink(&link);
+    pic.setPins(&eprom);
+    try {
+        fw_main();
+    }
+    catch (const SimDone& done) {
+        if (done.timeout)
+            return r;
+    }
+
+    const std::vector<Step>& steps = script.steps();
+    const Step& write = steps[2];
+    const Step& verify = steps[3];
+    const std::string& stats = steps[4].reply;
+    r.done = true;
+    r.faults = link.counts().total();
+    r.counted = counter(stats, "ferr") + counter(stats, "oerr") +
+                counter(stats, "drops");
+    for (size_t a = 0; a < img.length(); ++a) {
+        if (eprom.data()[a] != img.data[a])
+            r.misprog++;
+    }
+    r.stalled = write.aborted != 0;
+
+    simtime_t first = link.counts().first;
+    if (r.stalled)
+        r.recoverMs = (write.end - first) / 1e6;
+    else if (r.misprog)
+        r.recoverMs = (verify.end - first) / 1e6;
+    return r;
+}
+
+// ****************************************************************************
+static bool runChild(const Case& c, unsigned seed, double stallMs, Run& r)
+{
+    int fds[2];
+    if (pipe(fds) < 0) {
+        perror("pipe");
+        return false;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        Run res = runOnce(c, seed, stallMs);
+        ssize_t n = write(fds[1], &res, sizeof(res));
+        _exit(n == sizeof(res) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ssize_t n = read(fds[0], &r, sizeof(r));
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return n == sizeof(r) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// ****************************************************************************
+int main(int argc, char* argv[])
+{
+    int    runs = 10;
+    double stallMs = 60000;
+    std::vector<std::string> specs(std::begin(faultSpecs), std::end(faultSpecs));
+
+    int i;
+    for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i+1 < argc)
+            runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i+1 < argc)
+            stallMs = atof(argv[++i]);
+        else if (strcmp(argv[i], "-F") == 0 && i+1 < argc) {
+            Faults f;
+            std::string err;
+            specs.assign(1, argv[++i]);
+            if (!f.parse(specs[0], err)) {
+                fprintf(stderr, "%s\n", err.c_str());
+                return 2;
+            }
+        }
+        else {
+            fprintf(stderr, "usage: fault_bench [-n runs] [-s ms] [-F faults] "
+                            "[case...]\n");
+            return 2;
+        }
+    }
+    if (runs <= 0 || stallMs <= 0) {
+        fprintf(stderr, "runs and ms must be more than 0\n");
+        return 2;
+    }
+    std::vector<std::string> filters(argv + i, argv + argc);
+
+    printf("%-24s %6s %7s %7s %6s %7s %8s %11s %11s\n", "case", "runs",
+           "faults", "counted", "failed", "stalled", "misprog", "recover ms",
+           "max ms");
+    int failed = 0;
+    for (const Case& c : allCases(specs)) {
+        bool picked = filters.empty();
+        for (const std::string& f : filters)
+            picked |= c.name.compare(0, f.size(), f) == 0;
+        if (!picked)
+            continue;
+
+        // Means over the runs, and the bad ones
+        double faults = 0, counted = 0, misprog = 0, recover = 0, worst = 0;
+        int bad = 0, stalled = 0, n;
+        for (n = 0; n < runs; ++n) {
+            Run r;
+            if (!runChild(c, n + 1, stallMs, r) || !r.done)
+                break;
+            faults += r.faults;
+            counted += r.counted;
+            if (r.misprog || r.stalled) {
+                bad++;
+                misprog += r.misprog;
+                recover += r.recoverMs;
+                worst = std::max(worst, r.recoverMs);
+            }
+            if (r.stalled)
+                stalled++;
+        }
+        if (n < runs) {
+            printf("%-24s FAILED, run %d timed out\n", c.name.c_str(), n + 1);
+            failed++;
+            continue;
+        }
+        printf("%-24s %6d %7.1f %7.1f %6d %7d %8.1f %11.1f %11.1f\n",
+               c.name.c_str(), runs, faults / runs, counted / runs, bad,
+               stalled, bad ? misprog / bad : 0.0, bad ? recover / bad : 0.0,
+               worst);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,335 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/fw_bench.cpp
+// Environment          : Linux, g++
+//
+// Benchmark the firmware's cmds in the simulator: ping, soft reset,
+// identify, blank check, read and write, on each device, at several baud
+// rates, and for read and write at several image sparsities. For each the
+// virtual time, the chars on the wire (both ways) and the PIC's
+// instructions are compared with a baseline file, and a change worse than
+// the threshold fails.
+//
+// The instructions are the cycles the virtual time is made of, outside
+// the __delay_us/ms() calls: one for each register access, and the
+// estimate sim/cost.cpp charges for the firmware's code, sprintf()
+// included.
+//
+//   fw_bench [-f baseline] [-u] [-p percent] [case...]
+//
+// -u writes the baseline instead. Cases are picked by prefix, e.g. "read/".
+// Each case runs in its own process, so the firmware starts afresh.
+//
+// ****************************************************************************
+
+#include "eprom.h"
+#include "pic.h"
+#include "script.h"
+#include "../ihex.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+static const char* devices[] = { "8755", "8748", "8749", "2716", "2708" };
+// The isr takes about 190 cycles a char, see sim/cost.cpp, so much over
+// 200000 a stream of data overruns
+static const int   bauds[] = { 9600, 38400, 115200, 200000 };
+static const int   sparsities[] = { 0, 50, 90 };  // % of 16 byte blocks blank
+
+// What a case measures, of the cmd alone
+struct Result
+{
+    bool     ok;
+    uint64_t ns;                   // virtual time
+    uint64_t wire;                 // chars sent and received
+    uint64_t instrs;               // instructions, not counting delays
+};
+
+struct Case
+{
+    std::string name;              // e.g. "read/8755/115200/50"
+    std::string cmd;               // ping, soft, id, blank, read or write
+    std::string device;
+    int         baud;
+    int         sparsity;          // -1 if the cmd doesn't use an image
+};
+
+// ****************************************************************************
+// An image with the given % of its 16 byte blocks blank. The same every
+// time for a size and sparsity.
+//
+static Image makeImage(size_t size, int sparsity)
+{
+    std::mt19937 rng(8755 + sparsity);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::uniform_int_distribution<int> pct(0, 99);
+
+    Image img(size);
+    for (size_t a = 0; a < size; a += 16) {
+        bool blank = pct(rng) < sparsity;
+        for (size_t i = 0; i < 16; ++i) {
+            uint8_t b = (uint8_t) byte(rng);
+            if (!blank)
+                img.set(a + i, b);
+        }
+    }
+    return img;
+}
+
+// ****************************************************************************
+static std::vector<Case> allCases()
+{
+    std::vector<Case> cases;
+    for (const char* cmd :
+         { "ping", "soft", "id", "blank", "read", "write" }) {
+        bool image = strcmp(cmd, "read") == 0 || strcmp(cmd, "write") == 0;
+        for (const char* dev : devices) {
+            for (int baud : bauds) {
+                for (int sp : sparsities) {
+                    Case c;
+                    c.cmd = cmd;
+                    c.device = dev;
+                    c.baud = baud;
+                    c.sparsity = image ? sp : -1;
+                    c.name = c.cmd + "/" + dev + "/" + std::to_string(baud);
+                    if (image)
+                        c.name += "/" + std::to_string(sp);
+                    cases.push_back(c);
+                    if (!image)
+                        break;
+                }
+            }
+        }
+    }
+    return cases;
+}
+
+// ****************************************************************************
+// Run the case on the firmware. In a child process, as the firmware's
+// statics can't be reset.
+//
+static Result runCase(const Case& c)
+{
+    Eprom eprom;
+    eprom.init(c.device.c_str());
+    Image img = c.sparsity >= 0 ? makeImage(eprom.size(), c.sparsity)
+                                : Image(eprom.size());
+
+    ScriptLink link(c.baud);
+    link.add("init", "U");
+    link.add("type", std::string("$5") + eprom.code());
+
+    if (c.cmd == "ping")
+        link.add(c.cmd, "$P");
+    else if (c.cmd == "soft")
+        link.add(c.cmd, "$S");
+    else if (c.cmd == "id")
+        link.add(c.cmd, "$4");
+    else if (c.cmd == "blank")
+        link.add(c.cmd, "$3");
+    else if (c.cmd == "read") {
+        memcpy(eprom.data(), img.data.data(), eprom.size());
+        link.add(c.cmd, "$1");
+    }
+    else {
+        char head[8];
+        snprintf(head, sizeof(head), "$W%04x", (unsigned) img.length());
+        std::string s = head;
+        writeStream(img, img.length(), s);
+        std::vector<size_t> holds;
+        for (size_t a = SWEEP_BUF; eprom.swept() && a < img.length();
+             a += SWEEP_BUF)
+            holds.push_back(strlen(head) + a*2);
+        link.add(c.cmd, s, holds);
+    }
+
+    Result r = { false, 0, 0, 0 };
+    Pic& pic = Pic::get();
+    pic.setLink(&link);
+    pic.setPins(&eprom);
+    try {
+        fw_main();
+    }
+    catch (const SimDone& done) {
+        if (done.timeout)
+            return r;
+    }
+
+    const Step& s = link.steps().back();
+    r.ns = s.end - s.start;
+    r.wire = s.send.size() + s.reply.size();
+    r.instrs = s.instrs;
+
+    // Check it did the job
+    if (c.cmd == "id")
+        r.ok = s.reply == c.device;
+    else if (c.cmd == "ping" || c.cmd == "soft" || c.cmd == "blank" ||
+             c.cmd == "write")
+        r.ok = s.reply == "OK";
+    else
+        r.ok = s.reply.size() == eprom.size() / 16 * 54;
+    if (c.cmd == "write")
+        r.ok = r.ok && memcmp(eprom.data(), img.data.data(), eprom.size()) == 0;
+    return r;
+}
+
+// ****************************************************************************
+static bool runChild(const Case& c, Result& r)
+{
+    int fds[2];
+    if (pipe(fds) < 0) {
+        perror("pipe");
+        return false;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        Result res = runCase(c);
+        ssize_t n = write(fds[1], &res, sizeof(res));
+        _exit(n == sizeof(res) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ssize_t n = read(fds[0], &r, sizeof(r));
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return n == sizeof(r) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// ****************************************************************************
+// The baseline file has a line per case: name, ns, wire, instrs.
+//
+static bool loadBaseline(const std::string& path,
+                         std::map<std::string, Result>& base)
+{
+    FILE* f = fopen(path.c_str(), "r");
+    if (f == nullptr)
+        return false;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        char name[128];
+        unsigned long long ns, wire, instrs;
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%127s %llu %llu %llu", name, &ns, &wire, &instrs) == 4)
+            base[name] = Result{ true, ns, wire, instrs };
+    }
+    fclose(f);
+    return true;
+}
+
+// ****************************************************************************
+// How much worse new is than old, in %. Negative is better.
+//
+static double change(uint64_t old, uint64_t now)
+{
+    if (old == 0)
+        return now == 0 ? 0 : INFINITY;
+    return ((double) now - (double) old) * 100.0 / (double) old;
+}
+
+// ****************************************************************************
+int main(int argc, char* argv[])
+{
+    std::string path = "sim/baseline.txt";
+    bool   update = false;
+    double threshold = 2.0;
+
+    int i;
+    for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+        if (strcmp(argv[i], "-u") == 0)
+            update = true;
+        else if (strcmp(argv[i], "-f") == 0 && i+1 < argc)
+            path = argv[++i];
+        else if (strcmp(argv[i], "-p") == 0 && i+1 < argc)
+            threshold = atof(argv[++i]);
+        else {
+            fprintf(stderr, "usage: fw_bench [-f baseline] [-u] [-p percent] "
+                            "[case...]\n");
+            return 2;
+        }
+    }
+    std::vector<std::string> filters(argv + i, argv + argc);
+
+    std::map<std::string, Result> base;
+    if (!update && !loadBaseline(path, base))
+        fprintf(stderr, "no baseline %s, run with -u to make one\n", path.c_str());
+
+    FILE* out = nullptr;
+    if (update) {
+        out = fopen(path.c_str(), "w");
+        if (out == nullptr) {
+            perror(path.c_str());
+            return 1;
+        }
+        fprintf(out, "# fw_bench baseline: case, virtual ns, wire chars, "
+                     "instructions\n");
+    }
+
+    printf("%-24s %14s %8s %12s  %s\n", "case", "ms", "wire", "instrs",
+           "vs baseline");
+    int failed = 0;
+    for (const Case& c : allCases()) {
+        bool picked = filters.empty();
+        for (const std::string& f : filters)
+            picked |= c.name.compare(0, f.size(), f) == 0;
+        if (!picked)
+            continue;
+
+        Result r;
+        if (!runChild(c, r) || !r.ok) {
+            printf("%-24s FAILED\n", c.name.c_str());
+            failed++;
+            continue;
+        }
+        printf("%-24s %14.3f %8llu %12llu  ", c.name.c_str(), r.ns / 1e6,
+               (unsigned long long) r.wire, (unsigned long long) r.instrs);
+
+        if (out) {
+            fprintf(out, "%-24s %llu %llu %llu\n", c.name.c_str(),
+                    (unsigned long long) r.ns, (unsigned long long) r.wire,
+                    (unsigned long long) r.instrs);
+            printf("\n");
+            continue;
+        }
+
+        auto it = base.find(c.name);
+        if (it == base.end()) {
+            printf("new\n");
+            continue;
+        }
+        const Result& b = it->second;
+        double dt = change(b.ns, r.ns);
+        double dw = change(b.wire, r.wire);
+        double di = change(b.instrs, r.instrs);
+        bool worse = dt > threshold || dw > threshold || di > threshold;
+        printf("time %+.1f%% wire %+.1f%% instrs %+.1f%%%s\n", dt, dw, di,
+               worse ? "  REGRESSED" : "");
+        if (worse)
+            failed++;
+    }
+
+    if (out)
+        fclose(out);
+    if (failed) {
+        printf("%d cases failed or regressed by more than %.1f%%\n", failed,
+               threshold);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,511 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/pic.cpp
+// Environment          : Linux, g++
+//
+// ****************************************************************************
+
+#include "pic.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+// Register bits the model uses
+#define B_GIE     0x80             // INTCON
+#define B_PEIE    0x40
+#define B_RCIF    0x20             // PIR1, PIE1
+#define B_TXIF    0x10
+#define B_TMR1IF  0x01
+#define B_SPEN    0x80             // RCSTA
+#define B_CREN    0x10
+#define B_FERR    0x04
+#define B_OERR    0x02
+#define B_TXEN    0x20             // TXSTA
+#define B_TRMT    0x02
+#define B_ABDEN   0x01             // BAUDCON
+#define B_ABDOVF  0x80
+#define B_TMR1ON  0x01             // T1CON
+
+#define FOSC      20000000u        // the crystal
+#define ABD_CLOCK (32ull * 1000000000u / FOSC) // ns per auto baud count,
+                                   // Fosc/32 with BRG16 and BRGH
+#define RATE_TOL  4                // % the two ends' rates may differ
+
+#define ISR_CYCLES 6               // to get into and out of the isr
+#define LATE_CHARS 3               // LINK_LATE holds the isr off this long,
+                                   // enough for the FIFO to overrun
+
+// ****************************************************************************
+Pic& Pic::get()
+{
+    static Pic pic;
+    return pic;
+}
+
+// ****************************************************************************
+// Power on reset state
+//
+Pic::Pic() :
+    m_now(0),
+    m_cycles(0),
+    m_delayCycles(0),
+    m_owed(0),
+    m_link(nullptr),
+    m_pins(nullptr),
+    m_watcher(nullptr),
+    m_inIsr(false),
+    m_charTime(86806),
+    m_rxBusy(false),
+    m_rxChar(0),
+    m_rxDone(0),
+    m_abdEdges(0),
+    m_abdStart(0),
+    m_oerr(false),
+    m_rxTaken(0),
+    m_txDone(0),
+    m_overruns(0),
+    m_irqHold(0),
+    m_t1Start(0),
+    m_t1Ovf(0),
+    m_t1Held(0),
+    m_t1On(false)
+{
+    memset(m_reg, 0, sizeof(m_reg));
+    for (int i = SR_TRISA; i <= SR_TRISE; ++i)
+        m_reg[i] = 0xff;
+    for (int i = SR_ANSELA; i <= SR_ANSELE; ++i)
+        m_reg[i] = 0xff;
+}
+
+// ****************************************************************************
+// The host's baud rate sets the time a char takes, 10 bits.
+//
+void Pic::setLink(Link* link)
+{
+    m_link = link;
+    if (link)
+        m_charTime = 10000000000ull / link->baud();
+}
+
+// ****************************************************************************
+// Timer1 runs from Fosc/4 through the prescaler.
+//
+simtime_t Pic::t1Tick() const
+{
+    return SIM_CYCLE << ((m_reg[SR_T1CON] >> 4) & 3);
+}
+
+// ****************************************************************************
+uint16_t Pic::t1Count() const
+{
+    if (!m_t1On)
+        return m_t1Held;
+    return (uint16_t) ((m_now - m_t1Start) / t1Tick());
+}
+
+// ****************************************************************************
+void Pic::t1Set(uint16_t count)
+{
+    m_t1Held = count;
+    m_t1Start = m_now - (simtime_t) count * t1Tick();
+    m_t1Ovf = 0;
+}
+
+// ****************************************************************************
+simtime_t Pic::nextT1Overflow() const
+{
+    if (!m_t1On)
+        return (simtime_t) -1;
+    return m_t1Start + (m_t1Ovf + 1) * 65536 * t1Tick();
+}
+
+// ****************************************************************************
+// A char from the host can start arriving once the last one is in, if
+// the receiver is on and hasn't overrun.
+//
+void Pic::startRx()
+{
+    if (m_rxBusy || m_link == nullptr)
+        return;
+    if ((m_reg[SR_RCSTA] & (B_SPEN|B_CREN)) != (B_SPEN|B_CREN) || m_oerr)
+        return;
+
+    int c = m_link->hostChar(m_now, cts());
+    if (c < 0)
+        return;
+    m_rxBusy = true;
+    m_rxChar = c;
+    m_rxDone = m_now + m_charTime;
+}
+
+// ****************************************************************************
+// Does the BRG match the host's rate? With BRG16 and BRGH the rate is
+// Fosc / (4 * (n + 1)).
+//
+bool Pic::rateOk() const
+{
+    unsigned n = (m_reg[SR_SPBRGH] << 8) | m_reg[SR_SPBRG];
+    double rate = FOSC / (4.0 * (n + 1));
+    double err = rate / m_link->baud() - 1;
+    return err * 100 < RATE_TOL && err * 100 > -RATE_TOL;
+}
+
+// ****************************************************************************
+// Auto baud counts from the first rising edge on RX to the fifth, and
+// leaves the count less one in the BRG. A 'U' (0x55) has all five, from
+// the end of its start bit to the start of its stop bit, 8 bits, which
+// gives the host's rate. Any other char has fewer, so the count runs on
+// into the next char, or overflows, and the rate is wrong.
+//
+void Pic::autoBaud()
+{
+    simtime_t bit = m_charTime / 10;
+    simtime_t start = m_rxDone - m_charTime;
+    unsigned frame = ((m_rxChar & 0xff) << 1) | 0x200; // start 0, stop 1
+
+    for (int k = 1; k < 10; ++k) {
+        if (!((frame >> k) & 1) || ((frame >> (k-1)) & 1))
+            continue;
+        simtime_t t = start + k * bit;
+        if (m_abdEdges++ == 0)
+            m_abdStart = t;
+        if (m_abdEdges < 5)
+            continue;
+
+        // The rest of this char is lost
+        uint64_t count = (t - m_abdStart) / ABD_CLOCK;
+        if (count > 0xffff)
+            m_reg[SR_BAUDCON] |= B_ABDOVF;
+        unsigned n = (unsigned) (count - 1) & 0xffff;
+        m_reg[SR_SPBRG]  = n & 0xff;
+        m_reg[SR_SPBRGH] = n >> 8;
+        m_reg[SR_BAUDCON] &= ~B_ABDEN;
+        m_abdEdges = 0;
+        m_rxFifo.push_back(0);
+        return;
+    }
+}
+
+// ****************************************************************************
+// The stop bit is in. Auto baud takes its edges to set the BRG, otherwise
+// the char goes in the FIFO, or is lost with an overrun if it is full.
+// At the wrong rate it can't be framed, and is a framing error. A
+// LINK_LATE char then holds the isr off, as a long critical section
+// would.
+//
+void Pic::finishRx()
+{
+    m_rxBusy = false;
+
+    if (m_rxChar & LINK_LOST)
+        return;
+    if (m_reg[SR_BAUDCON] & B_ABDEN) {
+        autoBaud();
+        return;
+    }
+
+    if (!rateOk())
+        m_rxChar |= LINK_FERR;
+    if (m_rxFifo.size() >= 2) {
+        m_oerr = true;
+        m_overruns++;
+        return;
+    }
+    m_rxFifo.push_back((uint16_t) (m_rxChar & (0xff | LINK_FERR)));
+    if (m_rxChar & LINK_LATE)
+        m_irqHold = m_now + LATE_CHARS * m_charTime;
+}
+
+// ****************************************************************************
+// Take an interrupt if one is enabled and pending. The hardware clears
+// GIE on the way in and RETFIE sets it on the way out, and goes straight
+// back in if another is pending, e.g. a char the isr left in the FIFO.
+//
+void Pic::checkIrq()
+{
+    while (!m_inIsr && m_now >= m_irqHold) {
+        uint8_t intcon = m_reg[SR_INTCON];
+        if ((intcon & (B_GIE|B_PEIE)) != (B_GIE|B_PEIE))
+            return;
+
+        uint8_t pending = m_reg[SR_PIR1] & B_TMR1IF;
+        if (!m_rxFifo.empty())
+            pending |= B_RCIF;
+        if ((pending & m_reg[SR_PIE1]) == 0)
+            return;
+
+        m_inIsr = true;
+        m_reg[SR_INTCON] &= ~B_GIE;
+        simtime_t start = m_now;
+        step(ISR_CYCLES/2);
+        isr();
+        step(ISR_CYCLES/2);
+        if (m_rxTaken >= start)
+            m_rxTaken = m_now;
+        m_reg[SR_INTCON] |= B_GIE;
+        m_inIsr = false;
+    }
+}
+
+// ****************************************************************************
+// Move time on to 'to', handling the chars arriving and timer overflows
+// on the way, and taking any interrupts they cause.
+//
+void Pic::advance(simtime_t to)
+{
+    while (m_now < to) {
+        startRx();
+
+        simtime_t next = to;
+        if (m_rxBusy && m_rxDone < next)
+            next = m_rxDone;
+        simtime_t ovf = nextT1Overflow();
+        if (ovf < next)
+            next = ovf;
+        if (m_irqHold > m_now && m_irqHold < next)
+            next = m_irqHold;
+        m_now = next;
+
+        if (m_rxBusy && m_now >= m_rxDone)
+            finishRx();
+        if (m_t1On && m_now >= nextT1Overflow()) {
+            m_t1Ovf++;
+            m_reg[SR_PIR1] |= B_TMR1IF;
+        }
+
+        // The isr moves time on too
+        checkIrq();
+    }
+    startRx();
+}
+
+// ****************************************************************************
+void Pic::step(unsigned n)
+{
+    m_cycles += n;
+    simtime_t ns = (simtime_t) (n + m_owed) * SIM_CYCLE;
+    m_owed = 0;
+    advance(m_now + ns);
+}
+
+// ****************************************************************************
+// A delay loop is all cycles, so interrupts still happen, and make the
+// delay that much longer.
+//
+void Pic::delay(simtime_t ns)
+{
+    m_cycles += ns / SIM_CYCLE;
+    m_delayCycles += ns / SIM_CYCLE;
+    ns += (simtime_t) m_owed * SIM_CYCLE;
+    m_owed = 0;
+
+    // A long delay with nothing to receive is the firmware waiting
+    if (ns >= 100000000 && !m_rxBusy && m_rxFifo.empty() && m_link)
+        m_link->idle(m_now);
+
+    advance(m_now + ns);
+}
+
+// ****************************************************************************
+uint8_t Pic::read(int reg)
+{
+    step();
+
+    switch (reg) {
+    case SR_PORTA: case SR_PORTB: case SR_PORTC: case SR_PORTE:
+        return m_reg[SR_LATA + reg - SR_PORTA];
+    case SR_PORTD: {
+        uint8_t in = m_pins ? m_pins->portD(*this) : 0xff;
+        uint8_t tris = m_reg[SR_TRISD];
+        return (m_reg[SR_LATD] & ~tris) | (in & tris);
+    }
+    case SR_PIR1: {
+        uint8_t v = m_reg[SR_PIR1] & ~(B_RCIF|B_TXIF);
+        if (!m_rxFifo.empty())
+            v |= B_RCIF;
+        if (m_now + m_charTime >= m_txDone)
+            v |= B_TXIF;
+        return v;
+    }
+    case SR_RCSTA: {
+        uint8_t v = m_reg[SR_RCSTA] & ~(B_FERR|B_OERR);
+        if (m_oerr)
+            v |= B_OERR;
+        if (!m_rxFifo.empty() && (m_rxFifo.front() & LINK_FERR))
+            v |= B_FERR;
+        return v;
+    }
+    case SR_TXSTA: {
+        uint8_t v = m_reg[SR_TXSTA] & ~B_TRMT;
+        if (m_now >= m_txDone)
+            v |= B_TRMT;
+        return v;
+    }
+    case SR_RCREG: {
+        if (m_rxFifo.empty())
+            return 0;
+        uint8_t c = m_rxFifo.front() & 0xff;
+        m_rxFifo.pop_front();
+        m_rxTaken = m_now;
+        return c;
+    }
+    case SR_TMR1L:
+        return t1Count() & 0xff;
+    case SR_TMR1H:
+        return t1Count() >> 8;
+    default:
+        return m_reg[reg];
+    }
+}
+
+// ****************************************************************************
+void Pic::write(int reg, uint8_t v)
+{
+    step();
+
+    // Writing a port writes its latch
+    if (reg >= SR_PORTA && reg <= SR_PORTE)
+        reg = SR_LATA + reg - SR_PORTA;
+
+    switch (reg) {
+    case SR_PIR1:
+        // Only TMR1IF of the flags we model can be written
+        m_reg[SR_PIR1] = (m_reg[SR_PIR1] & ~B_TMR1IF) | (v & B_TMR1IF);
+        break;
+    case SR_RCSTA:
+        // Clearing CREN clears an overrun
+        if ((v & B_CREN) == 0)
+            m_oerr = false;
+        m_reg[SR_RCSTA] = v & ~(B_FERR|B_OERR);
+        break;
+    case SR_TXREG:
+        if (m_now > m_txDone)
+            m_txDone = m_now;
+        m_txDone += m_charTime;
+        // At the wrong rate the host can't frame it either, and a raw tty
+        // gives a framing error as a NUL
+        if (m_link)
+            m_link->picChar(m_txDone, rateOk() ? v : 0);
+        break;
+    case SR_T1CON: {
+        uint16_t count = t1Count();
+        m_reg[SR_T1CON] = v;
+        m_t1On = (v & B_TMR1ON) != 0;
+        t1Set(count);
+        break;
+    }
+    case SR_TMR1L:
+        t1Set((t1Count() & 0xff00) | v);
+        break;
+    case SR_TMR1H:
+        t1Set((t1Count() & 0x00ff) | (v << 8));
+        break;
+    case SR_INTCON:
+        // On the PIC an interrupt would nest, and overwrite the shadow
+        // registers with the isr's own context
+        if (m_inIsr && (v & B_GIE)) {
+            fprintf(stderr, "sim: GIE set in the isr\n");
+            abort();
+        }
+        m_reg[reg] = v;
+        break;
+    default:
+        m_reg[reg] = v;
+        break;
+    }
+
+    if ((reg >= SR_LATA && reg <= SR_LATD) ||
+        (reg >= SR_TRISA && reg <= SR_TRISD)) {
+        if (m_pins)
+            m_pins->changed(*this);
+    }
+
+    // Green LED on and orange off is the main loop waiting for a cmd
+    if (reg == SR_LATE && (v & 0x03) == 0x01 && m_link &&
+        !m_rxBusy && m_rxFifo.empty())
+        m_link->ready(m_now);
+
+    // Setting GIE or an enable may let a pending interrupt in
+    if (reg == SR_INTCON || reg == SR_PIE1)
+        checkIrq();
+}
+
+// ****************************************************************************
+// The hooks in xc.h
+//
+uint8_t sim_read(int reg)
+{
+    return Pic::get().read(reg);
+}
+
+void sim_write(int reg, uint8_t v)
+{
+    Pic::get().write(reg, v);
+}
+
+void sim_delay(uint64_t ns)
+{
+    Pic::get().delay(ns);
+}
+
+void sim_nop()
+{
+    Pic::get().step();
+}
+
+// ****************************************************************************
+// The only asm the firmware uses is RESET. The simulated PIC is a child
+// process, so the parent starts a new one with fresh statics.
+//
+void sim_asm(const char* s)
+{
+    if (strcmp(s, "RESET") == 0) {
+        fflush(stdout);
+        _exit(SIM_EXIT_RESET);
+    }
+    fprintf(stderr, "sim: unknown asm \"%s\"\n", s);
+    abort();
+}
+
+// ****************************************************************************
+// The registers
+//
+SimReg PORTA(SR_PORTA), PORTB(SR_PORTB), PORTC(SR_PORTC), PORTD(SR_PORTD),
+       PORTE(SR_PORTE);
+SimReg LATA(SR_LATA), LATB(SR_LATB), LATC(SR_LATC), LATD(SR_LATD),
+       LATE(SR_LATE);
+SimReg TRISA(SR_TRISA), TRISB(SR_TRISB), TRISC(SR_TRISC), TRISD(SR_TRISD),
+       TRISE(SR_TRISE);
+SimReg ANSELA(SR_ANSELA), ANSELB(SR_ANSELB), ANSELC(SR_ANSELC),
+       ANSELD(SR_ANSELD), ANSELE(SR_ANSELE);
+SimReg ADCON0(SR_ADCON0), INTCON(SR_INTCON), PIE1(SR_PIE1), PIR1(SR_PIR1);
+SimReg RCSTA(SR_RCSTA), TXSTA(SR_TXSTA), BAUDCON(SR_BAUDCON),
+       SPBRG(SR_SPBRG), SPBRGH(SR_SPBRGH), RCREG(SR_RCREG), TXREG(SR_TXREG);
+SimReg T1CON(SR_T1CON), TMR1L(SR_TMR1L), TMR1H(SR_TMR1H);
+
+PORTAbits_t   PORTAbits;
+PORTBbits_t   PORTBbits;
+PORTCbits_t   PORTCbits;
+PORTDbits_t   PORTDbits;
+PORTEbits_t   PORTEbits;
+LATAbits_t    LATAbits;
+LATBbits_t    LATBbits;
+LATCbits_t    LATCbits;
+LATDbits_t    LATDbits;
+LATEbits_t    LATEbits;
+TRISAbits_t   TRISAbits;
+TRISBbits_t   TRISBbits;
+TRISCbits_t   TRISCbits;
+TRISDbits_t   TRISDbits;
+TRISEbits_t   TRISEbits;
+ADCON0bits_t  ADCON0bits;
+INTCONbits_t  INTCONbits;
+PIE1bits_t    PIE1bits;
+PIR1bits_t    PIR1bits;
+RCSTAbits_t   RCSTAbits;
+TXSTAbits_t   TXSTAbits;
+BAUDCONbits_t BAUDCONbits;
+T1CONbits_t   T1CONbits;
@@ -0,0 +1,174 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/pic.h
+// Environment          : Linux, g++
+//
+// A model of the parts of the PIC 16F1789 the firmware uses: the ports,
+// the UART (auto baud from the bit edges, 2 char receive FIFO, overrun,
+// garbage both ways at the wrong rate), Timer1 and the interrupts. Time
+// is virtual, in ns. Each register access costs one instruction cycle
+// (200ns at 20MHz), delays cost what they say, and the firmware's code
+// between them an estimate, see sim/cost.cpp.
+//
+// ****************************************************************************
+
+#ifndef SIM_PIC_H
+#define SIM_PIC_H
+
+#include "xc.h"
+
+#include <deque>
+
+typedef uint64_t simtime_t;        // virtual time in ns
+
+#define SIM_CYCLE 200              // ns per instruction cycle, Fosc/4
+#define SIM_EXIT_RESET 3           // exit status of a firmware reset
+
+class Pic;
+
+// Flags a Link can add to a char from hostChar(), see sim/fault.h
+#define LINK_FERR 0x100            // it arrives with a framing error
+#define LINK_LATE 0x200            // the isr is then held off, see Pic
+#define LINK_LOST 0x400            // it takes its time but never arrives
+
+// The host end of the serial line.
+class Link
+{
+public:
+    virtual ~Link() {}
+
+    // The next char the host has for the PIC, or -1 if none yet, with
+    // any LINK_ flags. cts is true while the PIC has CTS set (stop
+    // sending).
+    virtual int  hostChar(simtime_t now, bool cts) = 0;
+
+    // A char from the PIC, finishing at time now.
+    virtual void picChar(simtime_t now, uint8_t c) = 0;
+
+    // The firmware is waiting for the host. May block for a while.
+    virtual void idle(simtime_t) {}
+
+    // The firmware is in its main loop, ready for a cmd.
+    virtual void ready(simtime_t now) { idle(now); }
+
+    // The baud rate the host is using.
+    virtual int  baud() const = 0;
+};
+
+// Whatever is on the PIC's pins (the device being programmed).
+class Pins
+{
+public:
+    virtual ~Pins() {}
+
+    // A LAT or TRIS register has been written.
+    virtual void changed(Pic& pic) = 0;
+
+    // What the device drives onto port D, 0xff if nothing.
+    virtual uint8_t portD(Pic& pic) = 0;
+};
+
+// Told of the firmware's function calls, see sim/cost.cpp.
+class CallWatcher
+{
+public:
+    virtual ~CallWatcher() {}
+    virtual void enter(void* fn) = 0;
+    virtual void exit(void* fn) = 0;
+};
+
+// Firmware entry points
+void fw_main(void);
+void isr(void);
+
+class Pic
+{
+public:
+    static Pic& get();
+
+    void setLink(Link* link);
+    void setPins(Pins* pins) { m_pins = pins; }
+    void setWatcher(CallWatcher* w) { m_watcher = w; }
+    CallWatcher* watcher() const { return m_watcher; }
+
+    simtime_t now() const { return m_now; }
+    uint64_t  cycles() const { return m_cycles; }
+
+    // Cycles spent in delays, so cycles() less this is the code's own
+    uint64_t  delayCycles() const { return m_delayCycles; }
+
+    // Register access, as the firmware sees it
+    uint8_t read(int reg);
+    void    write(int reg, uint8_t v);
+
+    // Busy wait for ns, as __delay_us() etc.
+    void    delay(simtime_t ns);
+
+    // Run n instruction cycles
+    void    step(unsigned n = 1);
+
+    // Count n cycles now, but run them at the next step() or delay(). For
+    // the hooks in sim/cost.cpp, which the compiler takes to never throw.
+    void    charge(unsigned n) { m_cycles += n; m_owed += n; }
+
+    // Output latches and directions, for the Pins
+    uint8_t lat(int port) const { return m_reg[SR_LATA + port]; }
+    uint8_t tris(int port) const { return m_reg[SR_TRISA + port]; }
+
+    // Has the firmware set CTS (stop sending)?
+    bool    cts() const { return (m_reg[SR_LATA] & 0x04) != 0; }
+
+    // Chars lost to receive overruns
+    uint64_t overruns() const { return m_overruns; }
+
+    // When the firmware last read a char from RCREG, or if the isr did,
+    // when the isr returned
+    simtime_t rxTaken() const { return m_rxTaken; }
+
+private:
+    Pic();
+
+    void advance(simtime_t to);
+    void startRx();
+    void finishRx();
+    void autoBaud();
+    bool rateOk() const;
+    void checkIrq();
+    simtime_t nextT1Overflow() const;
+    uint16_t  t1Count() const;
+    void      t1Set(uint16_t count);
+    simtime_t t1Tick() const;
+
+    uint8_t   m_reg[SR_COUNT];
+    simtime_t m_now;
+    uint64_t  m_cycles;
+    uint64_t  m_delayCycles;
+    uint64_t  m_owed;              // cycles charged, not run yet
+    Link*     m_link;
+    Pins*     m_pins;
+    CallWatcher* m_watcher;
+    bool      m_inIsr;
+
+    // UART
+    simtime_t m_charTime;          // ns per char, 10 bits
+    bool      m_rxBusy;            // a char is arriving
+    int       m_rxChar;
+    simtime_t m_rxDone;            // when it is complete
+    int       m_abdEdges;          // rising edges auto baud has seen
+    simtime_t m_abdStart;          // when the first was
+    std::deque<uint16_t> m_rxFifo; // RCREG, 2 deep, with LINK_FERR
+    bool      m_oerr;
+    simtime_t m_rxTaken;           // when RCREG was last read, see rxTaken()
+    simtime_t m_txDone;            // when the TSR is empty
+    uint64_t  m_overruns;
+    simtime_t m_irqHold;           // no interrupts until then, LINK_LATE
+
+    // Timer1
+    simtime_t m_t1Start;           // when the count was (notionally) 0
+    uint64_t  m_t1Ovf;             // overflows seen
+    uint16_t  m_t1Held;            // the count while it is off
+    bool      m_t1On;
+};
+
+#endif // SIM_PIC_H
@@ -0,0 +1,197 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/prgemu.cpp
+// Environment          : Linux, g++
+//
+// Emulate a programmer with a device in its socket on a pseudo terminal,
+// so the host (or several, see prg8755 -p) can be run without the
+// hardware. The firmware is the real main.c and uart.c, built against the
+// simulated PIC. e.g.
+//   prgemu -t 8755 -l /tmp/ttyPRG0 &
+//   prg8755 -p /tmp/ttyPRG0 job image.hex
+//
+// Time in the PIC is virtual: the firmware runs as fast as it can, except
+// while it waits for the host.
+//
+// -F injects faults on the line to the PIC once it is up, see sim/fault.h,
+// to try the host against a bad link.
+//
+// ****************************************************************************
+
+#include "eprom.h"
+#include "fault.h"
+#include "pic.h"
+#include "pty.h"
+#include "../ihex.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t stop = 0;
+
+// ****************************************************************************
+static void usage()
+{
+    fprintf(stderr,
+        "usage: prgemu [options]\n"
+        "options:\n"
+        "  -t type       device in the socket, 8755, 8748, 8749, 2716, 2732,\n"
+        "                2532, 2708 or T2716 (default 8755)\n"
+        "  -b baud       baud rate the host uses (default 115200)\n"
+        "  -l link       make a symlink to the pty\n"
+        "  -i file       Intel HEX file to load the device with\n"
+        "  -o file       Intel HEX file to save the device to on exit\n"
+        "  -F faults     inject link faults, e.g. ferr=1e-3,cts=8, see\n"
+        "                sim/fault.h\n"
+        "The pty is printed on stdout. Stop with SIGTERM or ^C.\n");
+    exit(2);
+}
+
+// ****************************************************************************
+static void onSignal(int)
+{
+    stop = 1;
+}
+
+// ****************************************************************************
+// Run the firmware until it resets. Returns the child's status.
+//
+static int runFirmware(int fd, int baud, Eprom& eprom, const Faults& faults)
+{
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        PtyLink pty(fd, baud);
+        FaultLink link(pty, faults);
+        link.armOnReady();
+        Pic& pic = Pic::get();
+        pic.setLink(&link);
+        pic.setPins(&eprom);
+        fw_main();
+        _exit(0);
+    }
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR)
+            return -1;
+        if (stop)
+            kill(pid, SIGTERM);
+    }
+    return status;
+}
+
+// ****************************************************************************
+int main(int argc, char* argv[])
+{
+    std::string type = "8755";
+    std::string link, in, out;
+    int baud = 115200;
+    Faults faults;
+    std::string err;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* opt = argv[i];
+        if (i+1 >= argc)
+            usage();
+        if (strcmp(opt, "-t") == 0)
+            type = argv[++i];
+        else if (strcmp(opt, "-b") == 0)
+            baud = atoi(argv[++i]);
+        else if (strcmp(opt, "-l") == 0)
+            link = argv[++i];
+        else if (strcmp(opt, "-i") == 0)
+            in = argv[++i];
+        else if (strcmp(opt, "-o") == 0)
+            out = argv[++i];
+        else if (strcmp(opt, "-F") == 0) {
+            if (!faults.parse(argv[++i], err)) {
+                fprintf(stderr, "%s\n", err.c_str());
+                return 2;
+            }
+        }
+        else
+            usage();
+    }
+    if (baud <= 0)
+        usage();
+
+    Eprom eprom;
+    if (!eprom.init(type.c_str())) {
+        fprintf(stderr, "unknown device type %s\n", type.c_str());
+        return 2;
+    }
+    if (!in.empty()) {
+        Image img(eprom.size());
+        if (!loadHex(in, img, err)) {
+            fprintf(stderr, "%s\n", err.c_str());
+            return 1;
+        }
+        memcpy(eprom.data(), img.data.data(), eprom.size());
+    }
+
+    // The pty. Keep the slave open, see openPty()
+    std::string path;
+    int slave;
+    int fd = openPty(path, slave, err);
+    if (fd < 0) {
+        fprintf(stderr, "%s\n", err.c_str());
+        return 1;
+    }
+
+    if (!link.empty()) {
+        unlink(link.c_str());
+        if (symlink(path.c_str(), link.c_str()) < 0) {
+            perror(link.c_str());
+            return 1;
+        }
+    }
+    printf("%s\n", path.c_str());
+    fflush(stdout);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onSignal;
+    sigaction(SIGTERM, &sa, nullptr);
+    sigaction(SIGINT, &sa, nullptr);
+
+    // The firmware resets by exiting, so start it again
+    int rc = 0;
+    while (!stop) {
+        int status = runFirmware(fd, baud, eprom, faults);
+        if (stop)
+            break;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == SIM_EXIT_RESET)
+            continue;
+        fprintf(stderr, "prgemu: firmware stopped, status %d\n", status);
+        rc = 1;
+        break;
+    }
+
+    if (!out.empty()) {
+        Image img(eprom.size());
+        for (size_t a = 0; a < eprom.size(); ++a)
+            img.set(a, eprom.data()[a]);
+        if (!saveHex(out, img, err)) {
+            fprintf(stderr, "%s\n", err.c_str());
+            rc = 1;
+        }
+    }
+    if (!link.empty())
+        unlink(link.c_str());
+    close(slave);
+    close(fd);
+    return rc;
+}
@@ -0,0 +1,356 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/prgsim.cpp
+// Environment          : Linux, g++
+//
+// Run cmds on the firmware in the simulator, in batch, with no pty. Each
+// cmd's virtual time, cycles and chars each way are printed. Optionally
+// the programming pins are traced to a VCD file (any waveform viewer,
+// e.g. GTKWave, reads it), and checked against the device's data sheet
+// timings, e.g.
+//   prgsim -t 8748 -v write.vcd -c write image.hex verify image.hex
+//
+// "abort ms" aborts the cmd before it that long after it starts, as ^C
+// in prg8755 does, and gives the time the firmware took to stop.
+//
+// -P profiles the firmware: where each cmd's instructions and delays go,
+// by function, as a flat profile and a call tree. The folded stacks go to
+// the file, for flamegraph.pl.
+//
+// ****************************************************************************
+
+#include "eprom.h"
+#include "pic.h"
+#include "profile.h"
+#include "script.h"
+#include "trace.h"
+#include "../dump.h"
+#include "../ihex.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// ****************************************************************************
+static void usage()
+{
+    fprintf(stderr,
+        "usage: prgsim [options] cmd [cmd...]\n"
+        "options:\n"
+        "  -t type       device, 8755, 8748, 8749, 2716, 2732, 2532, 2708\n"
+        "                or T2716 (default 8755)\n"
+        "  -b baud       baud rate (default 115200)\n"
+        "  -i file       Intel HEX file to load the device with first\n"
+        "  -o file       Intel HEX file to save the device to at the end\n"
+        "  -v file       trace the programming pins to a VCD file\n"
+        "  -c            check the data sheet timings, fail on a violation\n"
+        "  -P file       profile the firmware, folded stacks to file\n"
+        "cmds:\n"
+        "  id            show the device type set in the PIC\n"
+        "  blank         check the device is blank\n"
+        "  map           blank check all\n"
+        "  read file     read the device to an Intel HEX file\n"
+        "  write file    program an Intel HEX file\n"
+        "  verify file   compare the device with an Intel HEX file\n"
+        "  job file      blank, write and verify as one batch cmd\n"
+        "  abort ms      abort the last cmd ms after it starts\n"
+        "  ping          check the PIC answers\n"
+        "  soft          soft reset, then set the type again\n"
+        "  stats         the PIC's counters\n");
+    exit(2);
+}
+
+// ****************************************************************************
+static bool loadImage(const std::string& path, size_t size, Image& img)
+{
+    std::string err;
+    img = Image(size);
+    if (!loadHex(path, img, err)) {
+        fprintf(stderr, "%s\n", err.c_str());
+        return false;
+    }
+    return true;
+}
+
+// ****************************************************************************
+// Check a dump against the used bytes of want. Returns "OK" or what's
+// wrong.
+//
+static std::string checkDump(const std::string& dump, const Image& want,
+                             size_t size)
+{
+    Image img(size);
+    DumpParser parser(img, size);
+    parser.feed(dump.data(), dump.size());
+    if (!parser.done())
+        return "bad dump: " + parser.error();
+    size_t bad = 0;
+    for (size_t a = 0; a < want.size(); ++a) {
+        if (want.used[a] && want.data[a] != img.data[a])
+            ++bad;
+    }
+    return bad ? std::to_string(bad) + " bytes differ" : "OK";
+}
+
+// ****************************************************************************
+// The replies to a job's batch: "OK" for the blank check and the write,
+// the dump unless the write ended the batch, then "Done n". A 2708 class
+// part's "More"s are dropped first.
+//
+static std::string checkJob(std::string reply, const Image& want,
+                            const Eprom& eprom)
+{
+    size_t more;
+    while ((more = reply.find("More\n")) != std::string::npos)
+        reply.erase(more, 5);
+    if (reply.compare(0, 4, "OKOK") != 0)
+        return reply.substr(0, reply.find('\n'));
+    size_t done = reply.rfind("Done ");
+    if (done == std::string::npos)
+        return "no Done";
+    if (eprom.swept())
+        return reply.substr(done) == "Done 2\n" ? "OK" : reply.substr(done);
+    if (reply.substr(done) != "Done 3\n")
+        return reply.substr(done);
+    return checkDump(reply.substr(4, done - 4), want, eprom.size());
+}
+
+// ****************************************************************************
+// The last line of a reply, for the report.
+//
+static std::string lastLine(const std::string& reply)
+{
+    size_t end = reply.size();
+    while (end > 0 && reply[end-1] == '\n')
+        --end;
+    size_t nl = reply.rfind('\n', end ? end - 1 : 0);
+    size_t start = (nl == std::string::npos || nl >= end) ? 0 : nl + 1;
+    return reply.substr(start, end - start);
+}
+
+// ****************************************************************************
+int main(int argc, char* argv[])
+{
+    std::string type = "8755";
+    std::string in, out, vcd, prof;
+    int  baud = 115200;
+    bool check = false;
+
+    int i;
+    for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+        const char* opt = argv[i];
+        if (strcmp(opt, "-c") == 0) {
+            check = true;
+            continue;
+        }
+        if (i+1 >= argc)
+            usage();
+        if (strcmp(opt, "-t") == 0)
+            type = argv[++i];
+        else if (strcmp(opt, "-b") == 0)
+            baud = atoi(argv[++i]);
+        else if (strcmp(opt, "-i") == 0)
+            in = argv[++i];
+        else if (strcmp(opt, "-o") == 0)
+            out = argv[++i];
+        else if (strcmp(opt, "-v") == 0)
+            vcd = argv[++i];
+        else if (strcmp(opt, "-P") == 0)
+            prof = argv[++i];
+        else
+            usage();
+    }
+    if (i >= argc || baud <= 0)
+        usage();
+    std::vector<std::string> args(argv + i, argv + argc);
+
+    Eprom eprom;
+    if (!eprom.init(type.c_str())) {
+        fprintf(stderr, "unknown device type %s\n", type.c_str());
+        return 2;
+    }
+    if (!in.empty()) {
+        Image img;
+        if (!loadImage(in, eprom.size(), img))
+            return 1;
+        memcpy(eprom.data(), img.data.data(), eprom.size());
+    }
+
+    // The cmds, as prg8755 sends them
+    ScriptLink link(baud);
+    link.add("init", "U");
+    link.add("type", std::string("$5") + eprom.code());
+
+    std::vector<std::string> files;     // for read, by step
+    std::vector<Image> images;          // for verify, by step
+    for (size_t n = 0; n < args.size(); ++n) {
+        const std::string& cmd = args[n];
+        bool needFile = (cmd == "read" || cmd == "write" || cmd == "verify" ||
+                         cmd == "job" || cmd == "abort");
+        if (needFile && n+1 >= args.size())
+            usage();
+        if (cmd == "abort") {
+            double ms = atof(args[++n].c_str());
+            if (link.steps().size() < 3 || ms <= 0)
+                usage();
+            link.steps().back().abortAt = (simtime_t) (ms * 1e6);
+            continue;
+        }
+        files.resize(link.steps().size() + 1);
+        images.resize(link.steps().size() + 1);
+
+        if (cmd == "id")
+            link.add(cmd, "$4");
+        else if (cmd == "blank")
+            link.add(cmd, "$3");
+        else if (cmd == "map")
+            link.add(cmd, "$6");
+        else if (cmd == "stats")
+            link.add(cmd, "$70");
+        else if (cmd == "ping")
+            link.add(cmd, "$P");
+        else if (cmd == "soft") {
+            link.add(cmd, "$S");
+            files.resize(link.steps().size() + 1);
+            images.resize(link.steps().size() + 1);
+            link.add("type", std::string("$5") + eprom.code());
+        }
+        else if (cmd == "read") {
+            files.back() = args[++n];
+            link.add(cmd, "$1");
+        }
+        else if (cmd == "verify") {
+            if (!loadImage(args[++n], eprom.size(), images.back()))
+                return 1;
+            link.add(cmd, "$1");
+        }
+        else if (cmd == "write" || cmd == "job") {
+            Image img;
+            if (!loadImage(args[++n], eprom.size(), img))
+                return 1;
+            char head[12];
+            snprintf(head, sizeof(head), cmd == "job" ? "$B3W%04x" : "$W%04x",
+                     (unsigned) img.length());
+            std::string s = head;
+            writeStream(img, img.length(), s);
+            if (cmd == "job" && !eprom.swept())
+                s += "1.";
+            images.back() = img;
+
+            // The PIC asks for each SWEEP_BUF bytes after the first
+            std::vector<size_t> holds;
+            for (size_t a = SWEEP_BUF; eprom.swept() && a < img.length();
+                 a += SWEEP_BUF)
+                holds.push_back(strlen(head) + a*2);
+            link.add(cmd, s, holds);
+        }
+        else
+            usage();
+    }
+
+    Tracer tracer(eprom, eprom.kind());
+    if (!vcd.empty()) {
+        std::string err;
+        if (!tracer.openVcd(vcd, err)) {
+            fprintf(stderr, "%s\n", err.c_str());
+            return 1;
+        }
+    }
+
+    Pic& pic = Pic::get();
+    pic.setLink(&link);
+    pic.setPins(&tracer);
+    Profiler& profiler = Profiler::get();
+    if (!prof.empty()) {
+        profiler.start("startup");
+        link.onStep([&](const Step& s) { profiler.phase(s.name); });
+    }
+    bool timeout = true;
+    try {
+        fw_main();
+    }
+    catch (const SimDone& done) {
+        timeout = done.timeout;
+    }
+
+    // What each step did
+    int rc = 0;
+    std::vector<Step>& steps = link.steps();
+    for (size_t n = 0; n < steps.size(); ++n) {
+        Step& s = steps[n];
+        if (timeout && n == link.current()) {
+            printf("%-8s timed out\n", s.name.c_str());
+            rc = 1;
+            break;
+        }
+
+        std::string result = lastLine(s.reply);
+        if (s.aborted) {
+            char took[48];
+            snprintf(took, sizeof(took), "OK, aborted in %.3fms",
+                     (s.end - s.aborted) / 1e6);
+            result = result.size() >= 7 &&
+                     result.compare(result.size() - 7, 7, "Aborted") == 0 ?
+                     took : "bad abort reply: " + result;
+        }
+        else if (s.name == "read") {
+            Image img(eprom.size());
+            DumpParser parser(img, eprom.size());
+            parser.feed(s.reply.data(), s.reply.size());
+            std::string err;
+            if (!parser.done())
+                result = "bad dump: " + parser.error();
+            else
+                result = saveHex(files[n], img, err) ? "OK" : err;
+        }
+        else if (s.name == "verify")
+            result = checkDump(s.reply, images[n], eprom.size());
+        else if (s.name == "job")
+            result = checkJob(s.reply, images[n], eprom);
+        bool ok = (s.name == "init" || s.name == "id") ?
+                  !result.empty() && result != "ERROR" :
+                  result == "OK" || (s.aborted && result.compare(0, 3, "OK,") == 0);
+        if (!ok)
+            rc = 1;
+
+        printf("%-8s %12.3fms %12llu cycles %7zu tx %7zu rx  %s\n",
+               s.name.c_str(), (s.end - s.start) / 1e6,
+               (unsigned long long) s.cycles, s.send.size(), s.reply.size(),
+               result.c_str());
+        if (s.name == "stats")
+            printf("%s\n", s.reply.c_str());
+    }
+
+    if (check || tracer.violations() != 0)
+        printf("%zu timing violations\n", tracer.violations());
+    if (check && tracer.violations() != 0)
+        rc = 1;
+
+    if (!prof.empty()) {
+        profiler.report(stdout);
+        FILE* f = fopen(prof.c_str(), "w");
+        if (f == nullptr) {
+            perror(prof.c_str());
+            rc = 1;
+        }
+        else {
+            profiler.folded(f);
+            fclose(f);
+        }
+    }
+
+    if (!out.empty()) {
+        Image img(eprom.size());
+        for (size_t a = 0; a < eprom.size(); ++a)
+            img.set(a, eprom.data()[a]);
+        std::string err;
+        if (!saveHex(out, img, err)) {
+            fprintf(stderr, "%s\n", err.c_str());
+            rc = 1;
+        }
+    }
+    return rc;
+}
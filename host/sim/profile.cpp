@@ -0,0 +1,247 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/profile.cpp
+// Environment          : Linux, g++
+//
+// ****************************************************************************
+
+#include "profile.h"
+
+#include <algorithm>
+#include <cxxabi.h>
+#include <dlfcn.h>
+
+// Leave out of the call tree anything less than this, in 1/1000 of a cmd
+#define TREE_MIN      1
+
+// ****************************************************************************
+Profiler& Profiler::get()
+{
+    static Profiler prof;
+    return prof;
+}
+
+// ****************************************************************************
+void Profiler::start(const std::string& phase)
+{
+    Pic& pic = Pic::get();
+    m_cycles = pic.cycles();
+    m_delay = pic.delayCycles();
+    m_on = true;
+    pic.setWatcher(this);
+    this->phase(phase);
+}
+
+// ****************************************************************************
+// Charge the time since the last event to the function running.
+//
+void Profiler::charge()
+{
+    Pic& pic = Pic::get();
+    uint64_t cycles = pic.cycles() - m_cycles;
+    uint64_t delay = pic.delayCycles() - m_delay;
+    m_cycles = pic.cycles();
+    m_delay = pic.delayCycles();
+    if (m_node) {
+        m_node->instrs += cycles - delay;
+        m_node->delayNs += delay * SIM_CYCLE;
+    }
+}
+
+// ****************************************************************************
+Profiler::Node* Profiler::child(Node* n, void* fn)
+{
+    std::unique_ptr<Node>& c = n->children[fn];
+    if (!c) {
+        c.reset(new Node);
+        c->fn = fn;
+        c->parent = n;
+    }
+    return c.get();
+}
+
+// ****************************************************************************
+// The firmware's stack carries on into the new phase.
+//
+void Profiler::phase(const std::string& name)
+{
+    if (!m_on)
+        return;
+    charge();
+    if (m_roots.find(name) == m_roots.end())
+        m_phases.push_back(name);
+    m_node = &m_roots[name];
+    for (void* fn : m_stack)
+        m_node = child(m_node, fn);
+}
+
+// ****************************************************************************
+void Profiler::enter(void* fn)
+{
+    if (!m_on)
+        return;
+    charge();
+    m_stack.push_back(fn);
+    m_node = child(m_node, fn);
+    m_node->calls++;
+}
+
+// ****************************************************************************
+void Profiler::exit(void*)
+{
+    if (!m_on || m_stack.empty())
+        return;
+    charge();
+    m_stack.pop_back();
+    m_node = m_node->parent;
+}
+
+// ****************************************************************************
+// The function's name, without its C++ argument list.
+//
+std::string Profiler::name(void* fn)
+{
+    auto it = m_names.find(fn);
+    if (it != m_names.end())
+        return it->second;
+
+    std::string s;
+    Dl_info info;
+    if (dladdr(fn, &info) && info.dli_sname) {
+        int status;
+        char* dm = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr,
+                                       &status);
+        s = dm ? dm : info.dli_sname;
+        free(dm);
+        size_t paren = s.find('(');
+        if (paren != std::string::npos)
+            s.erase(paren);
+        if (s == "__wrap_sprintf")
+            s = "sprintf";
+    }
+    else {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%p", fn);
+        s = buf;
+    }
+    m_names[fn] = s;
+    return s;
+}
+
+// ****************************************************************************
+void Profiler::incl(Node* n, uint64_t& instrs, uint64_t& delayNs)
+{
+    instrs += n->instrs;
+    delayNs += n->delayNs;
+    for (auto& c : n->children)
+        incl(c.second.get(), instrs, delayNs);
+}
+
+// ****************************************************************************
+// Sum each function over the tree. Inclusive times count a recursive
+// function once.
+//
+void Profiler::totals(Node* n, std::map<void*, Total>& flat,
+                      std::vector<void*>& stack)
+{
+    for (auto& c : n->children) {
+        Node* k = c.second.get();
+        Total& t = flat[k->fn];
+        t.calls += k->calls;
+        t.instrs += k->instrs;
+        t.delayNs += k->delayNs;
+        if (std::find(stack.begin(), stack.end(), k->fn) == stack.end())
+            incl(k, t.inclInstrs, t.inclDelayNs);
+        stack.push_back(k->fn);
+        totals(k, flat, stack);
+        stack.pop_back();
+    }
+}
+
+// ****************************************************************************
+void Profiler::tree(FILE* out, Node* n, int depth, uint64_t phaseNs)
+{
+    std::vector<std::pair<uint64_t, Node*>> kids;
+    for (auto& c : n->children) {
+        uint64_t i = 0, d = 0;
+        incl(c.second.get(), i, d);
+        kids.push_back(std::make_pair(i * SIM_CYCLE + d, c.second.get()));
+    }
+    std::sort(kids.begin(), kids.end(),
+              [](const std::pair<uint64_t, Node*>& a,
+                 const std::pair<uint64_t, Node*>& b) {
+                  return a.first > b.first;
+              });
+
+    for (auto& k : kids) {
+        if (phaseNs == 0 || k.first * 1000 / phaseNs < TREE_MIN)
+            continue;
+        fprintf(out, "  %6.2f%% %10llu  %*s%s\n", k.first * 100.0 / phaseNs,
+                (unsigned long long) k.second->calls, depth * 2, "",
+                name(k.second->fn).c_str());
+        tree(out, k.second, depth + 1, phaseNs);
+    }
+}
+
+// ****************************************************************************
+void Profiler::report(FILE* out)
+{
+    charge();
+    for (const std::string& ph : m_phases) {
+        Node* root = &m_roots[ph];
+        uint64_t instrs = 0, delayNs = 0;
+        incl(root, instrs, delayNs);
+        uint64_t phaseNs = instrs * SIM_CYCLE + delayNs;
+        fprintf(out, "\n%s: %.3fms, %llu instrs, %.3fms in delays\n",
+                ph.c_str(), phaseNs / 1e6, (unsigned long long) instrs,
+                delayNs / 1e6);
+
+        // Flat, by self time
+        std::map<void*, Total> flat;
+        std::vector<void*> stack;
+        totals(root, flat, stack);
+        std::vector<std::pair<void*, Total>> rows(flat.begin(), flat.end());
+        std::sort(rows.begin(), rows.end(),
+                  [](const std::pair<void*, Total>& a,
+                     const std::pair<void*, Total>& b) {
+                      return a.second.instrs * SIM_CYCLE + a.second.delayNs >
+                             b.second.instrs * SIM_CYCLE + b.second.delayNs;
+                  });
+        fprintf(out, "  %7s %10s %12s %11s %12s %11s  %s\n", "self%",
+                "calls", "self instrs", "self delay", "incl instrs",
+                "incl delay", "function");
+        for (auto& r : rows) {
+            const Total& t = r.second;
+            uint64_t self = t.instrs * SIM_CYCLE + t.delayNs;
+            fprintf(out, "  %6.2f%% %10llu %12llu %9.3fms %12llu %9.3fms  %s\n",
+                    phaseNs ? self * 100.0 / phaseNs : 0.0,
+                    (unsigned long long) t.calls,
+                    (unsigned long long) t.instrs, t.delayNs / 1e6,
+                    (unsigned long long) t.inclInstrs, t.inclDelayNs / 1e6,
+                    name(r.first).c_str());
+        }
+
+        // Call tree, by inclusive time
+        fprintf(out, "  call tree, %% of the cmd's time, calls\n");
+        tree(out, root, 0, phaseNs);
+    }
+}
+
+// ****************************************************************************
+void Profiler::fold(FILE* out, Node* n, const std::string& path)
+{
+    uint64_t self = n->instrs * SIM_CYCLE + n->delayNs;
+    if (self)
+        fprintf(out, "%s %llu\n", path.c_str(), (unsigned long long) self);
+    for (auto& c : n->children)
+        fold(out, c.second.get(), path + ";" + name(c.first));
+}
+
+// ****************************************************************************
+void Profiler::folded(FILE* out)
+{
+    charge();
+    for (const std::string& ph : m_phases)
+        fold(out, &m_roots[ph], ph);
+}
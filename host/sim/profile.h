@@ -0,0 +1,88 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/profile.h
+// Environment          : Linux, g++
+//
+// Attributes the simulated PIC's cycles and delay time to the firmware's
+// functions, per cmd. The firmware is built with -finstrument-functions,
+// so every function entry and exit comes here, from sim/cost.cpp. That
+// also charges each call, basic block and sprintf() an estimate of what
+// XC8's code takes, so the code between register accesses isn't free.
+//
+// ****************************************************************************
+
+#ifndef SIM_PROFILE_H
+#define SIM_PROFILE_H
+
+#include "pic.h"
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Profiler : public CallWatcher
+{
+public:
+    static Profiler& get();
+
+    bool on() const { return m_on; }
+
+    // Start profiling, charging to the phase (a cmd) named
+    void start(const std::string& phase);
+
+    // Charge from now on to another phase
+    void phase(const std::string& name);
+
+    // From the instrumentation hooks
+    void enter(void* fn) override;
+    void exit(void* fn) override;
+
+    // Flat profile and call tree of each phase
+    void report(FILE* out);
+
+    // Folded stacks, "phase;fn;fn ns" a line, for flamegraph.pl
+    void folded(FILE* out);
+
+private:
+    struct Node {
+        void*    fn = nullptr;
+        uint64_t calls = 0;
+        uint64_t instrs = 0;       // self, not counting delays
+        uint64_t delayNs = 0;      // self, in __delay_us/ms()
+        std::map<void*, std::unique_ptr<Node>> children;
+        Node*    parent = nullptr;
+    };
+
+    struct Total {
+        uint64_t calls = 0;
+        uint64_t instrs = 0;
+        uint64_t delayNs = 0;
+        uint64_t inclInstrs = 0;
+        uint64_t inclDelayNs = 0;
+    };
+
+    Profiler() {}
+
+    void        charge();
+    Node*       child(Node* n, void* fn);
+    std::string name(void* fn);
+    void        totals(Node* n, std::map<void*, Total>& flat,
+                       std::vector<void*>& stack);
+    void        incl(Node* n, uint64_t& instrs, uint64_t& delayNs);
+    void        tree(FILE* out, Node* n, int depth, uint64_t phaseNs);
+    void        fold(FILE* out, Node* n, const std::string& path);
+
+    bool        m_on = false;
+    std::vector<std::string>    m_phases;   // in order
+    std::map<std::string, Node> m_roots;
+    std::vector<void*> m_stack;             // the firmware's call stack
+    Node*       m_node = nullptr;           // where time goes now
+    uint64_t    m_cycles = 0;               // Pic counts last charged
+    uint64_t    m_delay = 0;
+    std::map<void*, std::string> m_names;
+};
+
+#endif // SIM_PROFILE_H
@@ -0,0 +1,83 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/pty.cpp
+// Environment          : Linux, g++
+//
+// ****************************************************************************
+
+#include "pty.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define POLL_NS   50000            // how often the PIC looks at the pty
+#define IDLE_MS   10               // longest wait for the host when idle
+
+// ****************************************************************************
+int PtyLink::hostChar(simtime_t now, bool cts)
+{
+    // The host stops sending while CTS is set
+    if (cts || !m_started)
+        return -1;
+    if (m_pos == m_len && now - m_lastPoll >= POLL_NS) {
+        m_lastPoll = now;
+        ssize_t n = read(m_fd, m_buf, sizeof(m_buf));
+        m_pos = 0;
+        m_len = n > 0 ? n : 0;
+    }
+    if (m_pos == m_len)
+        return -1;
+    return m_buf[m_pos++];
+}
+
+// ****************************************************************************
+void PtyLink::picChar(simtime_t, uint8_t c)
+{
+    while (write(m_fd, &c, 1) < 0 && (errno == EAGAIN || errno == EINTR)) {
+        struct pollfd p = { m_fd, POLLOUT, 0 };
+        poll(&p, 1, IDLE_MS);
+    }
+}
+
+// ****************************************************************************
+void PtyLink::idle(simtime_t)
+{
+    m_started = true;
+    if (m_pos < m_len)
+        return;
+    struct pollfd p = { m_fd, POLLIN, 0 };
+    if (poll(&p, 1, IDLE_MS) > 0)
+        m_lastPoll = 0;
+}
+
+// ****************************************************************************
+int openPty(std::string& path, int& slave, std::string& err)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0) {
+        err = std::string("pty: ") + strerror(errno);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    path = ptsname(fd);
+    slave = open(path.c_str(), O_RDWR | O_NOCTTY);
+    struct termios tio;
+    if (slave < 0 || tcgetattr(slave, &tio) < 0) {
+        err = path + ": " + strerror(errno);
+        if (slave >= 0)
+            close(slave);
+        close(fd);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
@@ -0,0 +1,47 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/pty.h
+// Environment          : Linux, g++
+//
+// The simulated PIC's serial line on a pseudo terminal, with the host on
+// the other end, for prgemu and cold_start.
+//
+// ****************************************************************************
+
+#ifndef SIM_PTY_H
+#define SIM_PTY_H
+
+#include "pic.h"
+
+#include <string>
+
+// The host, on the master side of a pty. Nothing is read from it until
+// the firmware first waits for the host, as the PIC is up before the host
+// starts on the hardware.
+class PtyLink : public Link
+{
+public:
+    PtyLink(int fd, int baud) : m_fd(fd), m_baud(baud) {}
+
+    int  hostChar(simtime_t now, bool cts) override;
+    void picChar(simtime_t now, uint8_t c) override;
+    void idle(simtime_t now) override;
+    int  baud() const override { return m_baud; }
+
+private:
+    int       m_fd;
+    int       m_baud;
+    uint8_t   m_buf[64];           // read from the pty, not yet sent
+    size_t    m_pos = 0;
+    size_t    m_len = 0;
+    simtime_t m_lastPoll = 0;
+    bool      m_started = false;   // the firmware has waited for the host
+};
+
+// Open a pty. Returns the master, non-blocking, or -1 with err set. The
+// slave, path, is opened too, raw, and should be kept open so there's no
+// echo and no EIO on the master while the host isn't connected.
+int openPty(std::string& path, int& slave, std::string& err);
+
+#endif // SIM_PTY_H
@@ -0,0 +1,144 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/script.cpp
+// Environment          : Linux, g++
+//
+// ****************************************************************************
+
+#include "script.h"
+
+#include <algorithm>
+
+// The main loop can go round once more after the isr has taken the last
+// char of a cmd, so a step isn't done until this long after that. From
+// when the isr that took it returned, not when it came in, as the isr
+// takes a while.
+#define SETTLE_NS 20000
+
+#define ABORT 0x18                 // CMD_ABRT
+
+// ****************************************************************************
+ScriptLink::ScriptLink(int baud, simtime_t timeout) :
+    m_baud(baud),
+    m_charTime(10000000000ull / baud),
+    m_timeout(timeout)
+{
+}
+
+// ****************************************************************************
+void ScriptLink::add(const std::string& name, const std::string& send,
+                     const std::vector<size_t>& holds)
+{
+    Step s;
+    s.name = name;
+    s.send = send;
+    s.holds = holds;
+    m_steps.push_back(s);
+}
+
+// ****************************************************************************
+void ScriptLink::startStep(simtime_t now)
+{
+    Step& s = m_steps[m_cur];
+    s.start = now;
+    s.cycles = Pic::get().cycles();
+    s.instrs = s.cycles - Pic::get().delayCycles();
+    m_pos = 0;
+    m_more = 0;
+    if (m_onStep)
+        m_onStep(s);
+}
+
+// ****************************************************************************
+// Is the step waiting at a hold for the PIC's "More"?
+//
+bool ScriptLink::held(const Step& s) const
+{
+    for (size_t n = 0; n < s.holds.size(); ++n) {
+        if (s.holds[n] == m_pos && m_more <= n)
+            return true;
+    }
+    return false;
+}
+
+// ****************************************************************************
+// Drop the rest of the step and send the abort char.
+//
+int ScriptLink::abortStep(Step& s, simtime_t now)
+{
+    s.aborted = now;
+    m_pos = s.send.size();
+    m_lastDone = now + m_charTime;
+    return ABORT;
+}
+
+// ****************************************************************************
+// The next char of the step being sent. Nothing is sent until the
+// firmware first waits for the host, as if the host connected then.
+//
+int ScriptLink::hostChar(simtime_t now, bool cts)
+{
+    if (!m_started || m_cur >= m_steps.size())
+        return -1;
+
+    Step& s = m_steps[m_cur];
+    if (now - s.start > m_timeout)
+        throw SimDone{true};
+    if (!s.aborted) {
+        if (s.abortAt && now - s.start >= s.abortAt)
+            return abortStep(s, now);
+        simtime_t quiet = std::max(std::max(m_lastDone, m_lastRx), s.start);
+        if (m_stall && (m_pos >= s.send.size() || held(s)) &&
+            now >= quiet + m_stall)
+            return abortStep(s, now);
+    }
+    if (cts || m_pos >= s.send.size() || held(s))
+        return -1;
+
+    m_lastDone = now + m_charTime;
+    return (uint8_t) s.send[m_pos++];
+}
+
+// ****************************************************************************
+void ScriptLink::picChar(simtime_t now, uint8_t c)
+{
+    m_lastRx = now;
+    if (m_cur >= m_steps.size())
+        return;
+    std::string& reply = m_steps[m_cur].reply;
+    reply += (char) c;
+    if (c == '\n' && reply.size() >= 5 &&
+        reply.compare(reply.size() - 5, 5, "More\n") == 0)
+        m_more++;
+}
+
+// ****************************************************************************
+void ScriptLink::idle(simtime_t now)
+{
+    if (!m_started && !m_steps.empty()) {
+        m_started = true;
+        startStep(now);
+    }
+}
+
+// ****************************************************************************
+// The firmware is back in its main loop, so the step is done.
+//
+void ScriptLink::ready(simtime_t now)
+{
+    idle(now);
+    simtime_t last = std::max(m_lastDone, Pic::get().rxTaken());
+    if (m_cur >= m_steps.size() || m_pos < m_steps[m_cur].send.size() ||
+        now < last + SETTLE_NS)
+        return;
+
+    Step& s = m_steps[m_cur];
+    s.end = now;
+    s.cycles = Pic::get().cycles() - s.cycles;
+    s.instrs = Pic::get().cycles() - Pic::get().delayCycles() - s.instrs;
+
+    if (++m_cur == m_steps.size())
+        throw SimDone{false};
+    startStep(now);
+}
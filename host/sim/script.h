@@ -0,0 +1,93 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/script.h
+// Environment          : Linux, g++
+//
+// A host for running the firmware in batch: it sends a list of cmds, each
+// once the firmware is back in its main loop after the last, and keeps
+// the replies and virtual times. When the last cmd is done, or one takes
+// too long, SimDone is thrown out of the firmware.
+//
+// A step can be aborted part way: at abortAt the rest of it is dropped
+// and the abort char sent instead, whatever CTS says, as prg8755 does.
+// With a stall time set, any step is aborted if the PIC has sent nothing
+// for that long while the host waits for it, as the host's timeouts do.
+//
+// ****************************************************************************
+
+#ifndef SIM_SCRIPT_H
+#define SIM_SCRIPT_H
+
+#include "pic.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// One cmd and what came back
+struct Step
+{
+    std::string name;              // for reports, e.g. "read"
+    std::string send;              // the chars for the PIC
+    std::vector<size_t> holds;     // stop sending at each, until "More\n"
+    std::string reply;             // the chars from it
+    simtime_t   start = 0;         // when the first char was sent
+    simtime_t   end = 0;           // when the main loop was ready again
+    simtime_t   abortAt = 0;       // abort this long after start, 0 never
+    simtime_t   aborted = 0;       // when the abort was sent
+    uint64_t    cycles = 0;        // instruction cycles taken
+    uint64_t    instrs = 0;        // of those, the ones not in delays
+};
+
+// Thrown out of the firmware to stop it
+struct SimDone
+{
+    bool timeout;
+};
+
+class ScriptLink : public Link
+{
+public:
+    explicit ScriptLink(int baud, simtime_t timeout = 600000000000ull);
+
+    void add(const std::string& name, const std::string& send,
+             const std::vector<size_t>& holds = std::vector<size_t>());
+
+    std::vector<Step>& steps() { return m_steps; }
+
+    // Called as each step starts to be sent
+    void onStep(std::function<void(const Step&)> fn) { m_onStep = fn; }
+
+    // Abort a step once the PIC has been quiet for ns, 0 never
+    void setStall(simtime_t ns) { m_stall = ns; }
+
+    // The step that timed out, if any
+    size_t current() const { return m_cur; }
+
+    int  hostChar(simtime_t now, bool cts) override;
+    void picChar(simtime_t now, uint8_t c) override;
+    void idle(simtime_t now) override;
+    void ready(simtime_t now) override;
+    int  baud() const override { return m_baud; }
+
+private:
+    void startStep(simtime_t now);
+    bool held(const Step& s) const;
+    int  abortStep(Step& s, simtime_t now);
+
+    int               m_baud;
+    simtime_t         m_charTime;
+    simtime_t         m_timeout;   // longest a step may take
+    simtime_t         m_stall = 0; // quiet time before aborting a step
+    std::vector<Step> m_steps;
+    size_t            m_cur = 0;   // the step being sent
+    size_t            m_pos = 0;   // chars of it sent
+    size_t            m_more = 0;  // "More\n"s the PIC has sent for it
+    bool              m_started = false;
+    simtime_t         m_lastDone = 0; // when the last char sent is in
+    simtime_t         m_lastRx = 0;   // when the last char from the PIC was
+    std::function<void(const Step&)> m_onStep;
+};
+
+#endif // SIM_SCRIPT_H
@@ -0,0 +1,371 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/trace.cpp
+// Environment          : Linux, g++
+//
+// ****************************************************************************
+
+#include "trace.h"
+
+#include <cerrno>
+#include <cstring>
+
+#define FLOAT 0x80000000u          // AD when the PIC isn't driving it
+#define NONE  0xffffffffu          // not sampled yet
+
+#define US 1000ull
+#define MS 1000000ull
+
+typedef Tracer T;
+
+// ****************************************************************************
+// 8755A, from the Intel data sheet. The read times are for the 8755A, the
+// program pulse is the one the 8755A programming spec gives.
+//
+static const T::Rule rules8755[] = {
+    { "tAL", T::SETUP,  T::AD,    T::ALE, false,  50,     0,
+      "address to ALE setup" },
+    { "tLA", T::HOLD,   T::AD,    T::ALE, false,  80,     0,
+      "address hold after ALE" },
+    { "tLL", T::WIDTH,  T::ALE,   T::ALE, false,  100,    0,
+      "ALE pulse width" },
+    { "tRD", T::ACCESS, T::PORTD, T::RD_, false,  170,    0,
+      "RD_ to data out" },
+    { "tAD", T::ACCESS, T::PORTD, T::ALE, false,  450,    0,
+      "ALE to data out" },
+    { "tDS", T::SETUP,  T::AD,    T::VDD, true,   10*US,  0,
+      "data setup to program pulse" },
+    { "tPW", T::WIDTH,  T::VDD,   T::VDD, false,  45*MS,  55*MS,
+      "program pulse width" },
+};
+
+// ****************************************************************************
+// 8748/8749 program and verify mode, from the Intel data sheet. The times
+// are 4 tCY, where tCY is 5us with the 3MHz crystal the spec calls for.
+//
+static const T::Rule rules8748[] = {
+    { "tAW", T::SETUP,  T::AD,    T::RESET_, true,  20*US,  0,
+      "address setup to RESET_" },
+    { "tWA", T::HOLD,   T::AD,    T::RESET_, true,  20*US,  0,
+      "address hold after RESET_" },
+    { "tWW", T::WIDTH,  T::RESET_, T::RESET_, true, 20*US,  0,
+      "RESET_ pulse width" },
+    { "tDW", T::SETUP,  T::AD,    T::PROG,   true,  20*US,  0,
+      "data setup to PROG" },
+    { "tWD", T::HOLD,   T::AD,    T::PROG,   false, 20*US,  0,
+      "data hold after PROG" },
+    { "tPW", T::WIDTH,  T::PROG,  T::PROG,   false, 45*MS,  55*MS,
+      "PROG pulse width" },
+    { "tDO", T::ACCESS, T::PORTD, T::RESET_, true,  20*US,  0,
+      "RESET_ to data out" },
+};
+
+// ****************************************************************************
+// 2716, 2732 and 2532 on the adapter, from the Intel and TI data sheets.
+// The adapter's latch ('373) takes A0-7 on ALE, like the 8755. The program
+// pulse is on CE1_T0, hi on the 2716's CE_/PGM and lo on the 2732's CE_
+// and 2532's PD/PGM, with Vpp switched on just around it.
+//
+static const T::Rule rules2716[] = {
+    { "tAL", T::SETUP,  T::AD,    T::ALE, false,  50,     0,
+      "address to ALE setup" },
+    { "tLA", T::HOLD,   T::AD,    T::ALE, false,  50,     0,
+      "address hold after ALE" },
+    { "tOE", T::ACCESS, T::PORTD, T::RD_, false,  150,    0,
+      "OE_ to data out" },
+    { "tACC", T::ACCESS, T::PORTD, T::ALE, false, 450,    0,
+      "address to data out" },
+    { "tDS", T::SETUP,  T::AD,    T::VDD, true,   2*US,   0,
+      "data setup to Vpp and the program pulse" },
+    { "tVS", T::SETUP,  T::VDD,   T::CE1_, true,  2*US,   0,
+      "Vpp setup to the program pulse" },
+    { "tVH", T::HOLD,   T::VDD,   T::CE1_, false, 2*US,   0,
+      "Vpp hold after the program pulse", T::VDD },
+    { "tPW", T::WIDTH,  T::CE1_,  T::CE1_, false, 45*MS,  55*MS,
+      "CE_/PGM program pulse width", T::VDD },
+};
+
+static const T::Rule rules2732[] = {
+    { "tAL", T::SETUP,  T::AD,    T::ALE, false,  50,     0,
+      "address to ALE setup" },
+    { "tLA", T::HOLD,   T::AD,    T::ALE, false,  50,     0,
+      "address hold after ALE" },
+    { "tOE", T::ACCESS, T::PORTD, T::RD_, false,  150,    0,
+      "OE_ to data out" },
+    { "tACC", T::ACCESS, T::PORTD, T::ALE, false, 450,    0,
+      "address to data out" },
+    { "tDS", T::SETUP,  T::AD,    T::VDD, true,   2*US,   0,
+      "data setup to Vpp and the program pulse" },
+    { "tVS", T::SETUP,  T::VDD,   T::CE1_, false, 2*US,   0,
+      "Vpp setup to the program pulse" },
+    { "tVH", T::HOLD,   T::VDD,   T::CE1_, true,  2*US,   0,
+      "Vpp hold after the program pulse", T::VDD },
+    { "tPW", T::WIDTH,  T::CE1_,  T::CE1_, true,  45*MS,  55*MS,
+      "CE_ (PD/PGM) program pulse width", T::VDD },
+};
+
+// ****************************************************************************
+// 2708 and TMS2716, programmed in passes of short pulses.
+//
+static const T::Rule rules2708[] = {
+    { "tAL", T::SETUP,  T::AD,    T::ALE, false,  50,     0,
+      "address to ALE setup" },
+    { "tLA", T::HOLD,   T::AD,    T::ALE, false,  50,     0,
+      "address hold after ALE" },
+    { "tCO", T::ACCESS, T::PORTD, T::RD_, false,  120,    0,
+      "CS_ to data out" },
+    { "tACC", T::ACCESS, T::PORTD, T::ALE, false, 450,    0,
+      "address to data out" },
+    { "tDS", T::SETUP,  T::AD,    T::VDD, true,   10*US,  0,
+      "data setup to program pulse" },
+    { "tPW", T::WIDTH,  T::VDD,   T::VDD, false,  100*US, 1*MS,
+      "program pulse width" },
+};
+
+static const struct {
+    const char* name;
+    int         width;
+} signals[T::NSIGNALS] = {
+    { "SEL", 1 }, { "EA", 1 }, { "CTS", 1 }, { "PROG", 1 },
+    { "ALE", 1 }, { "CE2", 1 }, { "RD_", 1 }, { "VDD", 1 }, { "CE1_T0", 1 },
+    { "RESET_", 1 },
+    { "A11_8", 4 }, { "LATD", 8 }, { "TRISD", 8 }, { "PORTD", 8 },
+    { "AD", 12 },
+};
+
+#define READ_ID T::NSIGNALS        // the VCD event for a PORTD read
+
+// ****************************************************************************
+Tracer::Tracer(Pins& dev, Eprom::Kind kind) :
+    m_dev(dev)
+{
+    if (kind == Eprom::E8755) {
+        m_rules = rules8755;
+        m_nrules = sizeof(rules8755)/sizeof(rules8755[0]);
+    }
+    else if (kind == Eprom::E2708 || kind == Eprom::ET2716) {
+        m_rules = rules2708;
+        m_nrules = sizeof(rules2708)/sizeof(rules2708[0]);
+    }
+    else if (kind == Eprom::E2716) {
+        m_rules = rules2716;
+        m_nrules = sizeof(rules2716)/sizeof(rules2716[0]);
+    }
+    else if (kind == Eprom::E2732 || kind == Eprom::E2532) {
+        m_rules = rules2732;
+        m_nrules = sizeof(rules2732)/sizeof(rules2732[0]);
+    }
+    else {
+        m_rules = rules8748;
+        m_nrules = sizeof(rules8748)/sizeof(rules8748[0]);
+    }
+    m_armed.assign(m_nrules, false);
+
+    for (int i = 0; i < NSIGNALS; ++i) {
+        m_value[i] = NONE;
+        m_changed[i] = m_rose[i] = m_fell[i] = 0;
+    }
+}
+
+// ****************************************************************************
+Tracer::~Tracer()
+{
+    if (m_vcd)
+        fclose(m_vcd);
+}
+
+// ****************************************************************************
+bool Tracer::openVcd(const std::string& path, std::string& err)
+{
+    m_vcd = fopen(path.c_str(), "w");
+    if (m_vcd == nullptr) {
+        err = path + ": " + strerror(errno);
+        return false;
+    }
+    vcdHeader();
+    return true;
+}
+
+// ****************************************************************************
+static char vcdId(int sig)
+{
+    return (char) ('!' + sig);
+}
+
+// ****************************************************************************
+void Tracer::vcdHeader()
+{
+    fprintf(m_vcd, "$comment 8755prg simulator $end\n");
+    fprintf(m_vcd, "$timescale 1ns $end\n");
+    fprintf(m_vcd, "$scope module programmer $end\n");
+    for (int i = 0; i < NSIGNALS; ++i) {
+        fprintf(m_vcd, "$var wire %d %c %s $end\n", signals[i].width,
+                vcdId(i), signals[i].name);
+    }
+    fprintf(m_vcd, "$var event 1 %c PORTD_read $end\n", vcdId(READ_ID));
+    fprintf(m_vcd, "$upscope $end\n$enddefinitions $end\n");
+}
+
+// ****************************************************************************
+void Tracer::vcdTime(simtime_t now)
+{
+    if (now != m_vcdTime) {
+        fprintf(m_vcd, "#%llu\n", (unsigned long long) now);
+        m_vcdTime = now;
+    }
+}
+
+// ****************************************************************************
+void Tracer::vcdValue(int sig, uint32_t v)
+{
+    int width = signals[sig].width;
+    if (width == 1) {
+        fprintf(m_vcd, "%c%c\n", v ? '1' : '0', vcdId(sig));
+        return;
+    }
+    if (v == FLOAT) {
+        fprintf(m_vcd, "bz %c\n", vcdId(sig));
+        return;
+    }
+    char bits[33];
+    for (int i = 0; i < width; ++i)
+        bits[i] = (v >> (width - 1 - i)) & 1 ? '1' : '0';
+    bits[width] = 0;
+    fprintf(m_vcd, "b%s %c\n", bits, vcdId(sig));
+}
+
+// ****************************************************************************
+void Tracer::violation(const Rule& r, simtime_t now, simtime_t t)
+{
+    m_violations++;
+    if (m_violations > m_limit)
+        return;
+    if (r.max != 0 && t > r.max)
+        fprintf(stderr, "%12.3fus %s %s %.3fus, max %.3fus\n", now / 1e3,
+                r.name, r.what, t / 1e3, r.max / 1e3);
+    else
+        fprintf(stderr, "%12.3fus %s %s %.3fus, min %.3fus\n", now / 1e3,
+                r.name, r.what, t / 1e3, r.min / 1e3);
+}
+
+// ****************************************************************************
+// Read the pins after a LAT or TRIS write, and check the rules for the
+// ones that changed. Signals that change together have no setup or hold
+// time between them.
+//
+void Tracer::sample(Pic& pic)
+{
+    uint8_t a = pic.lat(0);
+    uint8_t b = pic.lat(1);
+    uint8_t latd = pic.lat(3);
+    uint8_t trisd = pic.tris(3);
+    uint8_t ahi = pic.lat(2) & 0x0f;
+
+    uint32_t v[NSIGNALS];
+    v[SEL]    = a & 1;
+    v[EA]     = (a >> 1) & 1;
+    v[CTS]    = (a >> 2) & 1;
+    v[PROG]   = (a >> 4) & 1;
+    v[ALE]    = b & 1;
+    v[CE2]    = (b >> 1) & 1;
+    v[RD_]    = (b >> 2) & 1;
+    v[VDD]    = (b >> 3) & 1;
+    v[CE1_]   = (b >> 4) & 1;
+    v[RESET_] = (b >> 5) & 1;
+    v[AHI]    = ahi;
+    v[LATD]   = latd;
+    v[TRISD]  = trisd;
+    v[PORTD]  = (latd & ~trisd) | (m_dev.portD(pic) & trisd);
+    v[AD]     = trisd == 0 ? (uint32_t) (latd | ahi << 8) : FLOAT;
+
+    simtime_t now = pic.now();
+    bool changed[NSIGNALS];
+    bool any = false;
+    for (int i = 0; i < NSIGNALS; ++i) {
+        changed[i] = v[i] != m_value[i];
+        any |= changed[i];
+    }
+    if (!any)
+        return;
+
+    // Edges: setup times, pulse widths, and start the hold times
+    for (size_t n = 0; n < m_nrules; ++n) {
+        const Rule& r = m_rules[n];
+        if (!changed[r.ref] || m_value[r.ref] == NONE || v[r.ref] != r.rise)
+            continue;
+        if (r.when != NSIGNALS && !v[r.when])
+            continue;
+        if (r.kind == SETUP) {
+            simtime_t t = changed[r.sig] ? 0 : now - m_changed[r.sig];
+            if (t < r.min)
+                violation(r, now, t);
+        }
+        else if (r.kind == WIDTH) {
+            simtime_t t = now - m_changed[r.ref];
+            if (t < r.min || (r.max != 0 && t > r.max))
+                violation(r, now, t);
+        }
+        else if (r.kind == HOLD) {
+            m_armed[n] = true;
+        }
+    }
+
+    // Record the changes, then finish any hold times they end
+    for (int i = 0; i < NSIGNALS; ++i) {
+        if (!changed[i])
+            continue;
+        if (m_vcd) {
+            vcdTime(now);
+            vcdValue(i, v[i]);
+        }
+        if (signals[i].width == 1 && m_value[i] != NONE) {
+            if (v[i])
+                m_rose[i] = now;
+            else
+                m_fell[i] = now;
+        }
+        m_value[i] = v[i];
+        m_changed[i] = now;
+    }
+
+    for (size_t n = 0; n < m_nrules; ++n) {
+        const Rule& r = m_rules[n];
+        if (r.kind != HOLD || !m_armed[n] || !changed[r.sig])
+            continue;
+        simtime_t edge = r.rise ? m_rose[r.ref] : m_fell[r.ref];
+        simtime_t t = now - edge;
+        if (t < r.min)
+            violation(r, now, t);
+        m_armed[n] = false;
+    }
+}
+
+// ****************************************************************************
+void Tracer::changed(Pic& pic)
+{
+    m_dev.changed(pic);
+    sample(pic);
+}
+
+// ****************************************************************************
+// The PIC is reading port D. Check the device has had time to drive it.
+//
+uint8_t Tracer::portD(Pic& pic)
+{
+    simtime_t now = pic.now();
+    if (m_vcd) {
+        vcdTime(now);
+        fprintf(m_vcd, "1%c\n", vcdId(READ_ID));
+    }
+
+    for (size_t n = 0; n < m_nrules; ++n) {
+        const Rule& r = m_rules[n];
+        if (r.kind != ACCESS || m_value[r.ref] != r.rise)
+            continue;
+        simtime_t t = now - (r.rise ? m_rose[r.ref] : m_fell[r.ref]);
+        if (t < r.min)
+            violation(r, now, t);
+    }
+    return m_dev.portD(pic);
+}
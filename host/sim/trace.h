@@ -0,0 +1,89 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/trace.h
+// Environment          : Linux, g++
+//
+// Sits between the PIC and the device, recording every change on the
+// programming pins to a VCD file with the virtual time, and checking the
+// device's setup, hold, pulse width and access times from its data sheet.
+//
+// ****************************************************************************
+
+#ifndef SIM_TRACE_H
+#define SIM_TRACE_H
+
+#include "eprom.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class Tracer : public Pins
+{
+public:
+    // The signals traced
+    enum Signal {
+        SEL, EA, CTS, PROG,                  // port A
+        ALE, CE2, RD_, VDD, CE1_, RESET_,    // port B, CE1_ is T0 on 8748
+        AHI, LATD, TRISD, PORTD,             // A8-11, port D
+        AD,                                  // what the PIC drives on AD0-11
+        NSIGNALS
+    };
+
+    // A rule from the data sheet. Times in ns, max 0 for no limit.
+    struct Rule {
+        const char* name;          // the data sheet's symbol, e.g. "tAL"
+        int         kind;          // see below
+        Signal      sig;           // the signal constrained
+        Signal      ref;           // the one it is timed from
+        bool        rise;          // which edge of ref
+        simtime_t   min;
+        simtime_t   max;
+        const char* what;
+        Signal      when = NSIGNALS; // only checked while this is high
+    };
+    enum {
+        SETUP,                     // sig stable for min before the edge
+        HOLD,                      // sig stable for min after the edge
+        WIDTH,                     // the pulse ending with the edge
+        ACCESS                     // PORTD read at least min after the edge
+    };
+
+    Tracer(Pins& dev, Eprom::Kind kind);
+    ~Tracer();
+
+    // Record to a VCD file as well as checking
+    bool openVcd(const std::string& path, std::string& err);
+
+    void    changed(Pic& pic) override;
+    uint8_t portD(Pic& pic) override;
+
+    size_t violations() const { return m_violations; }
+
+    // Print at most this many violations (the rest are just counted)
+    void   setReportLimit(size_t n) { m_limit = n; }
+
+private:
+    void sample(Pic& pic);
+    void vcdHeader();
+    void vcdValue(int sig, uint32_t v);
+    void vcdTime(simtime_t now);
+    void violation(const Rule& r, simtime_t now, simtime_t t);
+    void onChange(int sig, simtime_t now, uint32_t old);
+
+    Pins&       m_dev;
+    const Rule* m_rules;
+    size_t      m_nrules;
+    FILE*       m_vcd = nullptr;
+    simtime_t   m_vcdTime = (simtime_t) -1;
+    uint32_t    m_value[NSIGNALS];
+    simtime_t   m_changed[NSIGNALS];     // last change
+    simtime_t   m_rose[NSIGNALS];        // last rising edge
+    simtime_t   m_fell[NSIGNALS];        // last falling edge
+    std::vector<bool> m_armed;           // HOLD rules since their edge
+    size_t      m_violations = 0;
+    size_t      m_limit = 20;
+};
+
+#endif // SIM_TRACE_H
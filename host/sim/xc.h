@@ -0,0 +1,213 @@
+// ****************************************************************************
+//
+// Project              : 8755prg. 8755 / 8748 programmer
+// File                 : sim/xc.h
+// Environment          : Linux, g++
+//
+// Stands in for the XC8 <xc.h> so the firmware sources build unchanged as
+// C++ for the simulator. Every register access and delay goes through the
+// simulator (see pic.h), which keeps the virtual time.
+//
+// ****************************************************************************
+
+#ifndef SIM_XC_H
+#define SIM_XC_H
+
+#ifndef __cplusplus
+#error "the simulator builds the firmware as C++"
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The registers the simulator knows about
+enum SimRegId {
+    SR_PORTA, SR_PORTB, SR_PORTC, SR_PORTD, SR_PORTE,
+    SR_LATA,  SR_LATB,  SR_LATC,  SR_LATD,  SR_LATE,
+    SR_TRISA, SR_TRISB, SR_TRISC, SR_TRISD, SR_TRISE,
+    SR_ANSELA, SR_ANSELB, SR_ANSELC, SR_ANSELD, SR_ANSELE,
+    SR_ADCON0, SR_INTCON, SR_PIE1, SR_PIR1,
+    SR_RCSTA, SR_TXSTA, SR_BAUDCON, SR_SPBRG, SR_SPBRGH,
+    SR_RCREG, SR_TXREG, SR_T1CON, SR_TMR1L, SR_TMR1H,
+    SR_COUNT
+};
+
+uint8_t sim_read(int reg);
+void    sim_write(int reg, uint8_t v);
+void    sim_delay(uint64_t ns);
+void    sim_nop();
+void    sim_asm(const char* s);
+
+// A whole register
+class SimReg
+{
+public:
+    explicit SimReg(int id) : m_id(id) {}
+    operator uint8_t() const { return sim_read(m_id); }
+    SimReg& operator=(unsigned v) { sim_write(m_id, (uint8_t) v); return *this; }
+    SimReg& operator|=(unsigned v) { sim_write(m_id, sim_read(m_id) | v); return *this; }
+    SimReg& operator&=(unsigned v) { sim_write(m_id, sim_read(m_id) & v); return *this; }
+private:
+    SimReg(const SimReg&);
+    int m_id;
+};
+
+// A bit field in a register. Writes are read-modify-write, as on the PIC.
+class SimBit
+{
+public:
+    SimBit(int id, int bit, int width = 1) :
+        m_id(id), m_shift(bit), m_mask(((1u << width) - 1) << bit) {}
+    operator unsigned() const { return (sim_read(m_id) & m_mask) >> m_shift; }
+    SimBit& operator=(unsigned v)
+    {
+        uint8_t r = sim_read(m_id);
+        sim_write(m_id, (r & ~m_mask) | ((v << m_shift) & m_mask));
+        return *this;
+    }
+private:
+    SimBit(const SimBit&);
+    int      m_id;
+    int      m_shift;
+    unsigned m_mask;
+};
+
+#define SIM_BITS8(reg, p)                                                   \
+    SimBit p##0{reg, 0}; SimBit p##1{reg, 1}; SimBit p##2{reg, 2};          \
+    SimBit p##3{reg, 3}; SimBit p##4{reg, 4}; SimBit p##5{reg, 5};          \
+    SimBit p##6{reg, 6}; SimBit p##7{reg, 7}
+
+struct PORTAbits_t { SIM_BITS8(SR_PORTA, RA); };
+struct PORTBbits_t { SIM_BITS8(SR_PORTB, RB); };
+struct PORTCbits_t { SIM_BITS8(SR_PORTC, RC); };
+struct PORTDbits_t { SIM_BITS8(SR_PORTD, RD); };
+struct PORTEbits_t { SIM_BITS8(SR_PORTE, RE); };
+struct LATAbits_t  { SIM_BITS8(SR_LATA, LATA); };
+struct LATBbits_t  { SIM_BITS8(SR_LATB, LATB); };
+struct LATCbits_t  { SIM_BITS8(SR_LATC, LATC); };
+struct LATDbits_t  { SIM_BITS8(SR_LATD, LATD); };
+struct LATEbits_t  { SIM_BITS8(SR_LATE, LATE); };
+struct TRISAbits_t { SIM_BITS8(SR_TRISA, TRISA); };
+struct TRISBbits_t { SIM_BITS8(SR_TRISB, TRISB); };
+struct TRISCbits_t { SIM_BITS8(SR_TRISC, TRISC); };
+struct TRISDbits_t { SIM_BITS8(SR_TRISD, TRISD); };
+struct TRISEbits_t { SIM_BITS8(SR_TRISE, TRISE); };
+
+struct ADCON0bits_t {
+    SimBit ADON{SR_ADCON0, 0};
+    SimBit GO{SR_ADCON0, 1};
+    SimBit CHS{SR_ADCON0, 2, 5};
+};
+
+struct INTCONbits_t {
+    SimBit IOCIF{SR_INTCON, 0};
+    SimBit INTF{SR_INTCON, 1};
+    SimBit TMR0IF{SR_INTCON, 2};
+    SimBit IOCIE{SR_INTCON, 3};
+    SimBit INTE{SR_INTCON, 4};
+    SimBit TMR0IE{SR_INTCON, 5};
+    SimBit PEIE{SR_INTCON, 6};
+    SimBit GIE{SR_INTCON, 7};
+};
+
+struct PIE1bits_t {
+    SimBit TMR1IE{SR_PIE1, 0};
+    SimBit TMR2IE{SR_PIE1, 1};
+    SimBit CCP1IE{SR_PIE1, 2};
+    SimBit SSP1IE{SR_PIE1, 3};
+    SimBit TXIE{SR_PIE1, 4};
+    SimBit RCIE{SR_PIE1, 5};
+    SimBit ADIE{SR_PIE1, 6};
+    SimBit TMR1GIE{SR_PIE1, 7};
+};
+
+struct PIR1bits_t {
+    SimBit TMR1IF{SR_PIR1, 0};
+    SimBit TMR2IF{SR_PIR1, 1};
+    SimBit CCP1IF{SR_PIR1, 2};
+    SimBit SSP1IF{SR_PIR1, 3};
+    SimBit TXIF{SR_PIR1, 4};
+    SimBit RCIF{SR_PIR1, 5};
+    SimBit ADIF{SR_PIR1, 6};
+    SimBit TMR1GIF{SR_PIR1, 7};
+};
+
+struct RCSTAbits_t {
+    SimBit RX9D{SR_RCSTA, 0};
+    SimBit OERR{SR_RCSTA, 1};
+    SimBit FERR{SR_RCSTA, 2};
+    SimBit ADDEN{SR_RCSTA, 3};
+    SimBit CREN{SR_RCSTA, 4};
+    SimBit SREN{SR_RCSTA, 5};
+    SimBit RX9{SR_RCSTA, 6};
+    SimBit SPEN{SR_RCSTA, 7};
+};
+
+struct TXSTAbits_t {
+    SimBit TX9D{SR_TXSTA, 0};
+    SimBit TRMT{SR_TXSTA, 1};
+    SimBit BRGH{SR_TXSTA, 2};
+    SimBit SENDB{SR_TXSTA, 3};
+    SimBit SYNC{SR_TXSTA, 4};
+    SimBit TXEN{SR_TXSTA, 5};
+    SimBit TX9{SR_TXSTA, 6};
+    SimBit CSRC{SR_TXSTA, 7};
+};
+
+struct BAUDCONbits_t {
+    SimBit ABDEN{SR_BAUDCON, 0};
+    SimBit WUE{SR_BAUDCON, 1};
+    SimBit BRG16{SR_BAUDCON, 3};
+    SimBit SCKP{SR_BAUDCON, 4};
+    SimBit RCIDL{SR_BAUDCON, 6};
+    SimBit ABDOVF{SR_BAUDCON, 7};
+};
+
+struct T1CONbits_t {
+    SimBit TMR1ON{SR_T1CON, 0};
+    SimBit nT1SYNC{SR_T1CON, 2};
+    SimBit T1OSCEN{SR_T1CON, 3};
+    SimBit T1CKPS{SR_T1CON, 4, 2};
+    SimBit TMR1CS{SR_T1CON, 6, 2};
+};
+
+extern SimReg PORTA, PORTB, PORTC, PORTD, PORTE;
+extern SimReg LATA, LATB, LATC, LATD, LATE;
+extern SimReg TRISA, TRISB, TRISC, TRISD, TRISE;
+extern SimReg ANSELA, ANSELB, ANSELC, ANSELD, ANSELE;
+extern SimReg ADCON0, INTCON, PIE1, PIR1;
+extern SimReg RCSTA, TXSTA, BAUDCON, SPBRG, SPBRGH, RCREG, TXREG;
+extern SimReg T1CON, TMR1L, TMR1H;
+
+extern PORTAbits_t   PORTAbits;
+extern PORTBbits_t   PORTBbits;
+extern PORTCbits_t   PORTCbits;
+extern PORTDbits_t   PORTDbits;
+extern PORTEbits_t   PORTEbits;
+extern LATAbits_t    LATAbits;
+extern LATBbits_t    LATBbits;
+extern LATCbits_t    LATCbits;
+extern LATDbits_t    LATDbits;
+extern LATEbits_t    LATEbits;
+extern TRISAbits_t   TRISAbits;
+extern TRISBbits_t   TRISBbits;
+extern TRISCbits_t   TRISCbits;
+extern TRISDbits_t   TRISDbits;
+extern TRISEbits_t   TRISEbits;
+extern ADCON0bits_t  ADCON0bits;
+extern INTCONbits_t  INTCONbits;
+extern PIE1bits_t    PIE1bits;
+extern PIR1bits_t    PIR1bits;
+extern RCSTAbits_t   RCSTAbits;
+extern TXSTAbits_t   TXSTAbits;
+extern BAUDCONbits_t BAUDCONbits;
+extern T1CONbits_t   T1CONbits;
+
+// XC8 built-ins
+#define __delay_us(x)   sim_delay((uint64_t) (x) * 1000u)
+#define __delay_ms(x)   sim_delay((uint64_t) (x) * 1000000u)
+#define NOP()           sim_nop()
+#define __interrupt(...)
+#define asm(x)          sim_asm(x)
+
+#endif // SIM_XC_H